@@ -0,0 +1,195 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		decodebench.c
+  @brief	record decode micro benchmark
+
+  Feeds synthetic Ultimeter data logger records through the same path
+  get_observation() takes, without the serial port: station_frame(),
+  station_decode() (hex decode and unit conversion) and station_format().
+  Input is copied into the framer in read()-sized chunks.
+
+  decodebench [records]
+
+  Each case runs [records] records twice, with and without
+  station_format(), and reports ns per input record for both and the
+  allocations made while it ran (malloc, calloc and realloc are wrapped at
+  link time with -Wl,--wrap).
+
+  valid		good records only
+  truncated	every 8th record cut short, with or without its CR LF
+  corrupted	every 8th record with a bad hex digit or a noise byte
+  auto		good records, station type detected from the data
+ */
+/*---------------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "station.h"
+
+#define RECORDS 2000000		/* default records per case */
+#define POOL 8192		/* distinct records in the input stream */
+#define RECORD_LEN 52		/* "!!" + 48 hex + CR LF */
+#define READ_LEN 208		/* bytes per chunk, what a serial read returns */
+#define BAD_EVERY 8		/* one bad record in this many */
+
+enum { CASE_VALID, CASE_TRUNCATED, CASE_CORRUPTED, CASE_AUTO, CASES };
+
+static const char *case_name[CASES] = { "valid", "truncated", "corrupted", "auto" };
+
+static unsigned long allocs;
+static int counting;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+	if(counting)
+		allocs++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+	if(counting)
+		allocs++;
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+	if(counting)
+		allocs++;
+	return __real_realloc(p, size);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned int seed;
+
+/* small LCG, make_stream() seeds it so a case gets the same stream every run */
+static unsigned int rnd(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+/* a plausible record, the values move like a real station's */
+static void make_record(char *out, int i)
+{
+	char hex[49];
+
+	snprintf(hex, sizeof(hex), "%04X%04X%04X%s%04X",
+		 50 + abs(i % 200 - 100), (i / 8) % 256, 400 + abs(i % 100 - 50) / 10,
+		 "00000000000000000000000000000000", 40 + i % 100);
+	memcpy(out, "!!", 2);
+	memcpy(out+2, hex, 48);
+	memcpy(out+50, "\r\n", 2);
+}
+
+/* the input stream of a case, POOL records. returns its length */
+static int make_stream(char *out, int which)
+{
+	char rec[RECORD_LEN];
+	int i, len = 0, cut;
+
+	seed = 12345;
+	for(i=0; i<POOL; i++) {
+		make_record(rec, i);
+		if(which == CASE_TRUNCATED && i % BAD_EVERY == BAD_EVERY-1) {
+			cut = 2 + rnd() % 47;
+			memcpy(out+len, rec, cut);
+			len += cut;
+			if(rnd() & 1) {
+				memcpy(out+len, "\r\n", 2);
+				len += 2;
+			}
+			continue;
+		}
+		if(which == CASE_CORRUPTED && i % BAD_EVERY == BAD_EVERY-1) {
+			if(rnd() & 1)
+				rec[2 + rnd() % 48] = 'G';	/* not a hex digit */
+			else
+				rec[2 + rnd() % 48] = rnd() & 0xff;
+		}
+		memcpy(out+len, rec, RECORD_LEN);
+		len += RECORD_LEN;
+	}
+	return len;
+}
+
+/* ns per input record, format = 0 leaves out station_format() */
+static double run_case(int which, int records, int format, long *decoded, long *errors)
+{
+	static char stream[POOL * RECORD_LEN];
+	unsigned char line[STATION_MAX_LINE];
+	char text[STATION_MAX_LINE];
+	long done = 0;
+	int streamlen, pos, n, len, ret;
+	double start, secs;
+	OBSERVATION obs;
+	FRAMER fr;
+
+	streamlen = make_stream(stream, which);
+	station_framer_init(&fr, which == CASE_AUTO ? NULL : station_find("ultimeter"));
+
+	*decoded = *errors = 0;
+	counting = 1;
+	start = now();
+	for(pos=0; done < records; ) {
+		n = streamlen - pos < READ_LEN ? streamlen - pos : READ_LEN;
+		if(n > (int)sizeof(fr.buf) - fr.len)
+			n = sizeof(fr.buf) - fr.len;
+		memcpy(fr.buf+fr.len, stream+pos, n);
+		fr.len += n;
+		pos += n;
+		if(pos == streamlen) {
+			pos = 0;
+			done += POOL;
+		}
+
+		while((ret = station_frame(&fr, line, &len)) != 0) {
+			if(ret > 0 && station_decode(&fr, line, len, &obs) == STATION_OK) {
+				if(format)
+					station_format(&obs, text, sizeof(text));
+				(*decoded)++;
+			}
+			else
+				(*errors)++;
+		}
+	}
+	secs = now() - start;
+	counting = 0;
+
+	return secs * 1e9 / done;
+}
+
+int main(int argc, char *argv[])
+{
+	int records = argc > 1 ? atoi(argv[1]) : RECORDS;
+	long decoded, errors;
+	double decode, total;
+	int i;
+
+	/* stdout's buffer is allocated by the first printf, not in a case */
+	printf("decodebench: %d records per case, %d byte reads, ns per record\n", records, READ_LEN);
+	printf("decodebench: %-9s %8s %8s %8s %8s %6s\n", "case", "decode", "+format", "decoded", "errors", "allocs");
+	for(i=0; i<CASES; i++) {
+		allocs = 0;
+		decode = run_case(i, records, 0, &decoded, &errors);
+		total = run_case(i, records, 1, &decoded, &errors);
+		printf("decodebench: %-9s %8.1f %8.1f %8ld %8ld %6lu\n",
+		       case_name[i], decode, total, decoded, errors, allocs);
+	}
+	return 0;
+}
@@ -0,0 +1,174 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		ptysim.c
+  @brief	serial throughput benchmark for getwind
+
+  Runs getwind on a pseudo terminal that stands in for the station and
+  writes Ultimeter data logger records into it as fast as getwind takes
+  them. The records getwind has framed and decoded are read from its
+  metrics page, so the figures cover the whole input path: read(),
+  framing, decode, quality control and spooling.
+
+  ptysim <getwind> [records]
+
+  Uploads go to a closed local port and fail, so run it on a build host,
+  not next to a running getwind (both use /dev/shm/getwind.metrics).
+ */
+/*---------------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "metrics.h"
+
+#define RECORDS 200000		/* default record count */
+#define RECORD_LEN 52		/* "!!" + 48 hex + CR LF */
+#define CHUNK_RECORDS 64	/* records per write() */
+#define TIMEOUT 120		/* s before giving up */
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* a plausible record, the values move so nothing looks stuck */
+static void make_record(char *out, int i)
+{
+	char hex[49];
+
+	snprintf(hex, sizeof(hex), "%04X%04X%04X%s%04X",
+		 50 + abs(i % 200 - 100), (i / 8) % 256, 400 + abs(i % 100 - 50) / 10,
+		 "00000000000000000000000000000000", 40 + i % 100);
+	memcpy(out, "!!", 2);
+	memcpy(out+2, hex, 48);
+	memcpy(out+50, "\r\n", 2);
+}
+
+static const METRICS *attach_metrics(pid_t pid, double deadline)
+{
+	const METRICS *m;
+	int fd;
+
+	while(now() < deadline) {
+		fd = shm_open(METRICS_NAME, O_RDONLY, 0);
+		if(fd >= 0) {
+			m = mmap(NULL, sizeof(METRICS), PROT_READ, MAP_SHARED, fd, 0);
+			close(fd);
+			if(m != MAP_FAILED) {
+				if(m->magic == METRICS_MAGIC && m->size == sizeof(METRICS) && m->pid == (uint32_t)pid)
+					return m;
+				munmap((void *)m, sizeof(METRICS));
+			}
+		}
+		usleep(10000);
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	char dir[] = "/tmp/ptysimXXXXXX", conffile[64], *slave, *chunk, buf[64];
+	int master, records, i, j, n, written, ret = 1;
+	const METRICS *m;
+	double deadline, start, secs;
+	FILE *fp;
+	pid_t pid;
+
+	if(argc < 2) {
+		printf("Usage: ptysim <getwind> [records]\n");
+		return 1;
+	}
+	records = argc > 2 ? atoi(argv[2]) : RECORDS;
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if(master < 0 || grantpt(master) < 0 || unlockpt(master) < 0 || (slave = ptsname(master)) == NULL) {
+		printf("Error: no pseudo terminal\n");
+		return 1;
+	}
+
+	/* config: the pty as device, everything else out of the way */
+	if(mkdtemp(dir) == NULL)
+		return 1;
+	snprintf(conffile, sizeof(conffile), "%s/getwind.conf", dir);
+	fp = fopen(conffile, "w");
+	if(fp == NULL)
+		return 1;
+	fprintf(fp, "Device \"%s\"\nStation \"ultimeter\"\nBaud 115200\n"
+		"PostUrl \"http://127.0.0.1:9/\"\nRateClient \"\"\nBatch 1000\n"
+		"SpoolFile \"%s/spool\"\nStatusFile \"%s/status\"\n", slave, dir, dir);
+	fclose(fp);
+
+	pid = fork();
+	if(pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+
+		dup2(null, 1);
+		dup2(null, 2);
+		execl(argv[1], argv[1], "-c", conffile, (char *)NULL);
+		_exit(127);
+	}
+
+	deadline = now() + TIMEOUT;
+	m = attach_metrics(pid, deadline);
+	if(m == NULL) {
+		printf("Error: %s didn't start\n", argv[1]);
+		goto out;
+	}
+
+	/* the mode command comes once the port is set up */
+	for(n=0; n < 3 && now() < deadline; ) {
+		i = read(master, buf, sizeof(buf));
+		if(i > 0)
+			n += i;
+	}
+
+	chunk = malloc(CHUNK_RECORDS * RECORD_LEN);
+	start = now();
+	for(i=0; i<records; i+=n) {
+		n = records - i < CHUNK_RECORDS ? records - i : CHUNK_RECORDS;
+		for(j=0; j<n; j++)
+			make_record(chunk + j * RECORD_LEN, i + j);
+		for(written=0; written < n * RECORD_LEN; written += j) {
+			j = write(master, chunk + written, n * RECORD_LEN - written);
+			if(j <= 0 && errno != EINTR) {
+				printf("Error: write to the pty failed\n");
+				goto out;
+			}
+			if(j < 0)
+				j = 0;
+		}
+	}
+	while(m->records < (uint32_t)records && now() < deadline)
+		usleep(1000);
+	secs = now() - start;
+	free(chunk);
+
+	printf("ptysim: %u of %d records in %.3f s\n", m->records, records, secs);
+	printf("ptysim: %.0f records/s, %.2f MB/s\n", m->records / secs, m->serial_bytes / secs / 1e6);
+	printf("ptysim: %u reads, %.1f bytes per read, %u framing errors, %u qc rejects\n",
+	       m->serial_reads, m->serial_reads ? (double)m->serial_bytes / m->serial_reads : 0.0,
+	       m->framing_errors, m->qc_rejected);
+	ret = m->records == (uint32_t)records ? 0 : 1;
+
+out:
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	unlink(conffile);
+	snprintf(buf, sizeof(buf), "%s/spool", dir);
+	unlink(buf);
+	snprintf(buf, sizeof(buf), "%s/status", dir);
+	unlink(buf);
+	rmdir(dir);
+	return ret;
+}
@@ -0,0 +1,80 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		budget.c
+  @brief	monthly uplink budget from vnstat's traffic counters
+
+  The database is read with vnstat's own readdb() into vnstat's global
+  DATA, where mosecs() looks for it, so getwind follows whatever vnstatd
+  last saved, format conversions included. It is read without locking,
+  lockdb() could sleep for seconds while the serial port waits. That is
+  safe only because of how vnstatd saves: a full save replaces the
+  snapshot with a rename, so the snapshot read is always whole, but most
+  saves are appendjournal() writes into the journal. readjournal() takes
+  only a journal whose header base crc matches the snapshot just read and
+  applies only the saves whose records pass their crc and whose save-end
+  record crc covers them, a save still being written is left out. A
+  journal restarted in the middle of the read can leave the total one
+  save behind, the next read catches up. A change to the journal format
+  has to keep these checks or this read breaks (see JOURNALREC).
+  vnstat keeps month totals in MiB plus a KiB remainder.
+ */
+/*---------------------------------------------------------------------------*/
+
+#include "common.h"
+#include "dbaccess.h"
+#include "budget.h"
+
+void budget_init(BUDGET *b, int batch, int compress, int imageinterval)
+{
+	memset(b, 0, sizeof(BUDGET));
+	b->batch = batch < BUDGET_MAX_BATCH ? batch : BUDGET_MAX_BATCH;
+	b->compress = compress;
+	b->imageinterval = imageinterval;
+}
+
+/* read the month so far from vnstat and set the upload settings for the
+   rest of it. returns the level, -1 when the database can't be read (the
+   settings are left as they were) */
+int budget_check(BUDGET *b, const char *iface, const char *dbdir, uint64_t limit,
+		 int batch, int compress, int imageinterval)
+{
+	struct tm *d;
+	uint32_t elapsed;
+	uint64_t month;
+	int factor;
+
+	if(limit == 0) {
+		budget_init(b, batch, compress, imageinterval);
+		return BUDGET_NORMAL;
+	}
+
+	/* report errors instead of exiting, vnstat's tools exit on a bad db */
+	noexit = 1;
+	cfg.flock = 0;
+	cfg.monthrotate = MONTHROTATE;
+	if(readdb(&data, iface, dbdir) != 0 || data.version != DBVERSION)
+		return -1;
+
+	b->used = ((uint64_t)data.month[0].rx + data.month[0].tx) * 1024 * 1024 +
+		  ((uint64_t)data.month[0].rxk + data.month[0].txk) * 1024;
+
+	/* linear projection over the length of this month */
+	elapsed = mosecs();
+	d = localtime(&data.month[0].month);
+	month = (uint64_t)(d ? dmonth(d->tm_mon) : 30) * 86400;
+	b->projected = elapsed > 3600 ? b->used * month / elapsed : b->used;
+
+	if(b->projected > limit || b->used >= limit / 100 * BUDGET_CRITICAL_PCT)
+		b->level = BUDGET_CRITICAL;
+	else if(b->projected >= limit / 100 * BUDGET_SAVE_PCT)
+		b->level = BUDGET_SAVE;
+	else
+		b->level = BUDGET_NORMAL;
+
+	factor = b->level == BUDGET_CRITICAL ? BUDGET_CRITICAL_FACTOR :
+		 b->level == BUDGET_SAVE ? BUDGET_SAVE_FACTOR : 1;
+	b->batch = batch * factor < BUDGET_MAX_BATCH ? batch * factor : BUDGET_MAX_BATCH;
+	b->compress = b->level != BUDGET_NORMAL ? 1 : compress;
+	b->imageinterval = b->level == BUDGET_CRITICAL ? 0 : imageinterval * factor;
+	return b->level;
+}
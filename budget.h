@@ -0,0 +1,47 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		budget.h
+  @brief	monthly uplink budget from vnstat's traffic counters
+
+  The current month's rx+tx of the uplink interface is read from vnstat's
+  database and projected to the end of the month. While the projection
+  stays under BUDGET_SAVE_PCT of the budget getwind uploads as configured,
+  above that batches grow and compression is forced on, and once the month
+  is projected to go over (or BUDGET_CRITICAL_PCT is used) batches grow
+  further and camera images are paused. Batches never grow past
+  BUDGET_MAX_BATCH records. The image interval is only advice,
+  it is exported in the metrics page for the camera upload to follow.
+ */
+/*---------------------------------------------------------------------------*/
+
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <stdint.h>
+
+#define BUDGET_NORMAL 0
+#define BUDGET_SAVE 1
+#define BUDGET_CRITICAL 2
+
+#define BUDGET_CHECK 300	/* s between database reads, vnstatd saves every 5 min */
+#define BUDGET_SAVE_PCT 80	/* projected % of the budget that starts saving */
+#define BUDGET_CRITICAL_PCT 95	/* used % of the budget that is critical regardless */
+#define BUDGET_SAVE_FACTOR 4	/* batch and image interval multiplier when saving */
+#define BUDGET_CRITICAL_FACTOR 16
+#define BUDGET_MAX_BATCH 256	/* records per upload at most, what fits UPLOAD_BATCH_SIZE */
+
+typedef struct {
+	int level;
+	uint64_t used;		/* bytes this month */
+	uint64_t projected;	/* bytes by the end of the month at the current rate */
+	int batch;		/* records per upload */
+	int compress;
+	int imageinterval;	/* s between camera images, 0 = none */
+	long lastcheck;
+} BUDGET;
+
+void budget_init(BUDGET *b, int batch, int compress, int imageinterval);
+int budget_check(BUDGET *b, const char *iface, const char *dbdir, uint64_t limit,
+		 int batch, int compress, int imageinterval);
+
+#endif
@@ -0,0 +1,153 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		config.c
+  @brief	getwind configuration file
+
+  Settings are read from CONFIG_FILE (or getwind -c file) at startup and
+  again on SIGHUP. Lines are "Name value" or "Name = value", # starts a
+  comment and string values may be quoted.
+ */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "config.h"
+#include "serial.h"
+#include "health.h"
+#include "station.h"
+
+void config_default(CONFIG *c)
+{
+	memset(c, 0, sizeof(CONFIG));
+	strncpy(c->device, SERIAL_DEVICE, sizeof(c->device)-1);
+	c->port = SERIAL_PORT;
+	c->baud = SERIAL_BAUD;
+	strncpy(c->station, STATION_TYPE, sizeof(c->station)-1);
+	c->interval = SAMPLE_INTERVAL;
+	c->qc = QUALITY_CONTROL;
+	strncpy(c->post_url, POST_URL, sizeof(c->post_url)-1);
+	strncpy(c->post_user, POST_USER, sizeof(c->post_user)-1);
+	strncpy(c->post_password, POST_PASSWORD, sizeof(c->post_password)-1);
+	strncpy(c->post_cafile, POST_CAFILE, sizeof(c->post_cafile)-1);
+	c->batch = POST_BATCH;
+	c->compress = POST_COMPRESS;
+	c->budget = BUDGET_MB;
+	strncpy(c->budget_iface, BUDGET_INTERFACE, sizeof(c->budget_iface)-1);
+	strncpy(c->vnstat_dir, VNSTAT_DIR, sizeof(c->vnstat_dir)-1);
+	c->image_interval = IMAGE_INTERVAL;
+	strncpy(c->rate_client, RATE_CLIENT, sizeof(c->rate_client)-1);
+	c->spool_size = SPOOL_SIZE;
+	strncpy(c->spool_file, SPOOL_FILE, sizeof(c->spool_file)-1);
+	strncpy(c->status_file, STATUS_FILE, sizeof(c->status_file)-1);
+	c->status_interval = STATUS_INTERVAL;
+	c->serial_stale = HEALTH_SERIAL_STALE;
+	c->max_errors = HEALTH_MAX_ERRORS;
+}
+
+/* returns 1 when the file was read, 0 when it doesn't exist (defaults are
+   used) and -1 on errors, c is left untouched then */
+int config_load(CONFIG *c, const char *file)
+{
+	CONFIG new;
+	FILE *fp;
+	char line[512], name[64], *value, *end;
+	int i, lineno = 0, ret = 1;
+
+	struct confsetting cset[] = {
+		{ "Device", new.device, 0, sizeof(new.device) },
+		{ "Port", 0, &new.port, 0 },
+		{ "Baud", 0, &new.baud, 0 },
+		{ "Station", new.station, 0, sizeof(new.station) },
+		{ "SampleInterval", 0, &new.interval, 0 },
+		{ "QualityControl", 0, &new.qc, 0 },
+		{ "PostUrl", new.post_url, 0, sizeof(new.post_url) },
+		{ "PostUser", new.post_user, 0, sizeof(new.post_user) },
+		{ "PostPassword", new.post_password, 0, sizeof(new.post_password) },
+		{ "PostCAFile", new.post_cafile, 0, sizeof(new.post_cafile) },
+		{ "Batch", 0, &new.batch, 0 },
+		{ "Compress", 0, &new.compress, 0 },
+		{ "BudgetMB", 0, &new.budget, 0 },
+		{ "BudgetInterface", new.budget_iface, 0, sizeof(new.budget_iface) },
+		{ "VnstatDir", new.vnstat_dir, 0, sizeof(new.vnstat_dir) },
+		{ "ImageInterval", 0, &new.image_interval, 0 },
+		{ "RateClient", new.rate_client, 0, sizeof(new.rate_client) },
+		{ "SpoolSize", 0, &new.spool_size, 0 },
+		{ "SpoolFile", new.spool_file, 0, sizeof(new.spool_file) },
+		{ "StatusFile", new.status_file, 0, sizeof(new.status_file) },
+		{ "StatusInterval", 0, &new.status_interval, 0 },
+		{ "SerialStale", 0, &new.serial_stale, 0 },
+		{ "MaxErrors", 0, &new.max_errors, 0 },
+		{ 0, 0, 0, 0 }
+	};
+
+	config_default(&new);
+
+	if((fp = fopen(file, "r")) == NULL) {
+		*c = new;
+		return 0;
+	}
+
+	while(fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+
+		if((end = strchr(line, '#')) != NULL)
+			*end = '\0';
+		if(sscanf(line, " %63[A-Za-z0-9]", name) != 1)
+			continue;
+
+		/* value after the name and an optional '=', quotes removed */
+		value = strstr(line, name) + strlen(name);
+		while(isspace((unsigned char)*value) || *value == '=')
+			value++;
+		end = value + strlen(value);
+		while(end > value && isspace((unsigned char)end[-1]))
+			*--end = '\0';
+		if(*value == '"' && end > value && end[-1] == '"') {
+			*--end = '\0';
+			value++;
+		}
+
+		for(i=0; cset[i].name; i++) {
+			if(strcasecmp(name, cset[i].name) == 0)
+				break;
+		}
+		if(cset[i].name == NULL) {
+			printf("Config: unknown setting \"%s\" on line %d of %s, ignoring\n", name, lineno, file);
+			continue;
+		}
+
+		if(cset[i].locc) {
+			if(strlen(value) >= (size_t)cset[i].len) {
+				printf("Config: value of %s too long on line %d\n", name, lineno);
+				ret = -1;
+				continue;
+			}
+			strcpy(cset[i].locc, value);
+		}
+		else {
+			*cset[i].loci = strtol(value, &end, 0);
+			if(*value == '\0' || *end != '\0') {
+				printf("Config: invalid number \"%s\" for %s on line %d\n", value, name, lineno);
+				ret = -1;
+			}
+		}
+	}
+	fclose(fp);
+
+	if(new.port < 0 || new.port >= MAX_PORT_NUM || new.baud <= 0 || new.interval < 0 || new.budget < 0 || new.image_interval < 0 || new.batch < 1 || new.spool_size < 1024 ||
+	   new.status_interval < 1 || new.serial_stale < 1 || new.max_errors < 1) {
+		printf("Config: out of range value in %s\n", file);
+		ret = -1;
+	}
+
+	if(strcmp(new.station, "auto") != 0 && station_find(new.station) == NULL) {
+		printf("Config: unknown station \"%s\" in %s\n", new.station, file);
+		ret = -1;
+	}
+
+	if(ret > 0)
+		*c = new;
+	return ret;
+}
@@ -0,0 +1,81 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		config.h
+  @brief	getwind configuration file
+
+  Settings are read from CONFIG_FILE (or getwind -c file) at startup and
+  again on SIGHUP. The values below are only defaults for settings the file
+  doesn't give.
+ */
+/*---------------------------------------------------------------------------*/
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define CONFIG_FILE "/etc/getwind.conf"
+
+/* serial port, device overrides the /dev/ttyM<port> name */
+#define SERIAL_PORT 2		/* PORT3 */
+#define SERIAL_DEVICE ""
+#define SERIAL_BAUD 2400
+
+#define STATION_TYPE "ultimeter"	/* protocol driver, or "auto" to detect it */
+#define QUALITY_CONTROL 1	/* filter spikes, jumps and stuck sensors */
+#define SAMPLE_INTERVAL 0	/* s of samples per observation, 0 = every record */
+
+#define POST_URL "https://some.web.server.com/update.php"
+#define POST_USER "johan"
+#define POST_PASSWORD "blaj"
+#define POST_CAFILE ""		/* PEM file with the server CA, "" = system store */
+#define POST_BATCH 10		/* records per upload */
+#define POST_COMPRESS 1		/* deflate batches */
+
+#define BUDGET_MB 0		/* monthly uplink budget in MiB, 0 = none */
+#define BUDGET_INTERFACE "ppp0"	/* uplink interface in vnstat's database */
+#define VNSTAT_DIR "/var/lib/vnstat"
+#define IMAGE_INTERVAL 300	/* s between camera images within budget */
+
+#define RATE_CLIENT "wind"	/* client in the shared uplink rate control, "" = none */
+
+#define SPOOL_SIZE 262144	/* bytes of records kept while the uplink is down */
+#define SPOOL_FILE "/home/wind/getwind.spool"
+#define STATUS_FILE "/var/run/getwind.status"
+#define STATUS_INTERVAL 60	/* s between status file updates */
+
+typedef struct {
+	char device[64];
+	int port;
+	int baud;
+	char station[32];
+	int interval;
+	int qc;
+	char post_url[256];
+	char post_user[64];
+	char post_password[64];
+	char post_cafile[256];
+	int batch;
+	int compress;
+	int budget;
+	char budget_iface[32];
+	char vnstat_dir[256];
+	int image_interval;
+	char rate_client[16];
+	int spool_size;
+	char spool_file[256];
+	char status_file[256];
+	int status_interval;
+	int serial_stale;
+	int max_errors;
+} CONFIG;
+
+struct confsetting {
+	const char *name;
+	char *locc;
+	int *loci;
+	short len;
+};
+
+void config_default(CONFIG *c);
+int config_load(CONFIG *c, const char *file);
+
+#endif
@@ -18,51 +18,128 @@
 /*---------------------------------------------------------------------------*/
 
 #include <stdio.h>
+#include <signal.h>
+#include <time.h>
 #include "serial.h"
+#include "upload.h"
+#include "spool.h"
+#include "health.h"
+#include "metrics.h"
+#include "config.h"
+#include "station.h"
+#include "qc.h"
+#include "latest.h"
+#include "budget.h"
+#include "ratelimit.h"
 
-#define SPEED_OFFSET 0
-#define DIRECTION_OFFSET 4
-#define TEMPERATURE_OFFSET 8
-#define AVGSPEED_OFFSET 44
+#define LINE_LEN 128	/* room for one observation line in a batch, UPLOAD_BATCH_SIZE / BUDGET_MAX_BATCH */
 
-#define POST_URL "http://some.web.server.com/update.php"
-#define POST_USER "johan"
-#define POST_PASSWORD "blaj"
+static volatile sig_atomic_t running = 1;
+static volatile sig_atomic_t dumpstatus = 0;
+static volatile sig_atomic_t reload = 0;
+static HEALTH health;
+static CONFIG conf;
+static FRAMER framer;
+static QC qc;
+static BUDGET budget;
+static RATELIMIT *rate = NULL;
+static uint64_t readrealtime, readmonotonic;	/* when the last serial read returned */
+static uint64_t lastmonotonic;			/* stamp of the last observation */
 
-int get_value(unsigned char* buf, int offset)
+static void sighandler(int sig)
 {
-	int i, ret=0;
-	for(i=0; i<4; i++) {
-		if(buf[offset+i] > 0x39) {
-			printf("%x", buf[offset+i]-55);
-			ret = ret | (buf[offset+i] - 55) << ((3-i)*4);
+	if(sig == SIGUSR1)
+		dumpstatus = 1;
+	else if(sig == SIGHUP)
+		reload = 1;
+	else
+		running = 0;
+}
+
+static uint64_t clock_ns(clockid_t id)
+{
+	struct timespec ts;
+
+	clock_gettime(id, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* read the next record and decode it, returns 1 for an observation, 0 on
+   timeout or error from SerialBlockRead. Input is read in chunks and framed
+   from the buffer, not a byte per read(). The observation is stamped with
+   the time its CR/LF arrived: the time of the read, less the bytes that
+   came in after it at the line speed */
+int get_observation(int fd, OBSERVATION *obs, int timeout)
+{
+	unsigned char line[STATION_MAX_LINE];
+	uint64_t start, behind;
+	int len, ret;
+
+	while(1) {
+		ret = station_frame(&framer, line, &len);
+		if(ret > 0) {
+			start = metrics_clock();
+			ret = station_decode(&framer, line, len, obs);
+			metrics_observe(&metrics->decode, start);
+			if(ret == STATION_OK) {
+				behind = (uint64_t)framer.len * 10 * 1000000000 / conf.baud;
+				/* data that came faster than the line speed (a pty) must
+				   not put the stamps out of order */
+				if(readmonotonic - behind < lastmonotonic)
+					behind = readmonotonic - lastmonotonic;
+				obs->realtime = readrealtime - behind;
+				obs->monotonic = readmonotonic - behind;
+				lastmonotonic = obs->monotonic;
+				health_record(&health, 1);
+				METRIC_ADD(records, 1);
+				return 1;
+			}
+			if(ret == STATION_ERROR_CHECKSUM) {
+				printf("Error: Checksum incorrect!\n");
+				METRIC_ADD(checksum_errors, 1);
+			}
+			else {
+				printf("Error: Record invalid!\n");
+				METRIC_ADD(framing_errors, 1);
+			}
+			health_record(&health, 0);
+			continue;
 		}
-		else {
-			printf("%x", buf[offset+i]-48);
-			ret = ret | (buf[offset+i] - 48) << ((3-i)*4);
+		if(ret < 0) {
+			printf("Error: End of data incorrect!\n");
+			health_record(&health, 0);
+			METRIC_ADD(framing_errors, 1);
+			continue;
+		}
+
+		ret = SerialWaitRead(fd, timeout);
+		if(ret <= 0)
+			return ret;
+
+		ret = SerialBlockRead(fd, (char *)framer.buf+framer.len, sizeof(framer.buf)-framer.len);
+		readrealtime = clock_ns(CLOCK_REALTIME);
+		readmonotonic = clock_ns(CLOCK_MONOTONIC);
+		if(ret <= 0) {
+			framer.len = 0;
+			return ret < 0 ? ret : -1;
 		}
+		framer.len += ret;
+		METRIC_ADD(serial_reads, 1);
+		METRIC_ADD(serial_bytes, ret);
 	}
-	printf(" ret = %d\n", ret);
-	return ret;	
 }
 
-void get_data_header(int fd)
+/* open and configure the port and put the station in the configured mode */
+int open_station(int fd)
 {
-	unsigned char buf[1];
-	do {
-                SerialBlockRead(fd, buf, 1);
-        } while(buf[0] != '!');
-	return;
-}
+	const STATION *drv = station_find(conf.station);
+	int ret;
 
-int main()
-{
-	unsigned char buf[255];
-	int i, len,ret, fd=PORT3, direction;
-	float speed, temperature, avgspeed;
-	
 	printf("Opening serial port...");
-	ret = SerialOpen(fd);
+	if(conf.device[0])
+		ret = SerialOpenDevice(fd, conf.device);
+	else
+		ret = SerialOpen(fd);
 	if(ret < 0) {
 		printf("Error: SerialOpen returned: %d\n", ret);
 		SerialClose(fd);
@@ -71,7 +148,7 @@ int main()
 	printf("Done\n");	
 
 	printf("Setting port speed...");
-	ret = SerialSetSpeed(fd, 2400);
+	ret = SerialSetSpeed(fd, conf.baud);
 	if(ret < 0) {
 		printf("Error: SerialSetSpeed returned: %d\n", ret);
 		SerialClose(fd);
@@ -97,61 +174,387 @@ int main()
 	}
 	printf("Done\n");
 
-	printf("Setting data logger mode...");
-	ret = SerialWrite(fd, ">I\r", 3); // data logger mode
+	/* a read returns a whole record rather than a byte per wakeup */
+	printf("Setting read burst...");
+	ret = SerialSetReadBurst(fd, drv ? drv->minlen + 2 : 16, 1);
 	if(ret < 0) {
-		printf("Error: SerialWrite returned: %d\n", ret);
+		printf("Error: SerialSetReadBurst returned: %d\n", ret);
 		SerialClose(fd);
 		return -1;
 	}
 	printf("Done\n");
-	
 
-	printf("Waiting for header...");
-	get_data_header(fd);
-	get_data_header(fd);
-	printf("Found\n");
+	station_framer_init(&framer, drv);
 
-	printf("Waiting for data...");
-	ret = SerialBlockRead(fd, buf, 50); // read data
+	/* auto still selects a mode: an Ultimeter is put in data logger mode,
+	   the one with the current speed, other stations ignore the command */
+	if(drv == NULL)
+		drv = station_find("ultimeter");
+	if(drv && drv->init) {
+		printf("Setting %s mode...", drv->name);
+		ret = SerialWrite(fd, (char *)drv->init, strlen(drv->init));
+		if(ret < 0) {
+			printf("Error: SerialWrite returned: %d\n", ret);
+			SerialClose(fd);
+			return -1;
+		}
+		printf("Done\n");
+	}
+
+	return 0;
+}
+
+/* ask the shared uplink rate control whether the batch may go now, taken
+   is set to the tokens taken for it. The segment and the client are looked
+   up until ratectl has set them up, without them uploads are not limited */
+int upload_allowed(UPLOADER *up, long long *taken)
+{
+	int client;
+	long long bytes;
+
+	*taken = 0;
+	if(conf.rate_client[0] == '\0')
+		return 1;
+	if(rate == NULL && (rate = RateOpen(0)) == NULL)
+		return 1;
+	if((client = RateFindClient(rate, conf.rate_client)) < 0)
+		return 1;
+
+	/* compressed size from the ratio so far, plus the request header */
+	bytes = up->batchlen;
+	if(up->compress && up->rawbytes > 0)
+		bytes = bytes * up->sentbytes / up->rawbytes;
+	if(RateTake(rate, client, bytes + 256) != RATE_OK)
+		return 0;
+	*taken = bytes + 256;
+	return 1;
+}
+
+/* give back the tokens of a batch that failed, so a dead uplink doesn't
+   drain the budget the camera shares */
+void upload_refund(long long taken)
+{
+	int client;
+
+	if(taken > 0 && rate != NULL && (client = RateFindClient(rate, conf.rate_client)) >= 0)
+		RateGive(rate, client, taken);
+}
+
+/* move spooled records to the uploader batch and send it */
+void upload_spool(UPLOADER *up, SPOOL *sp)
+{
+	unsigned long sent;
+	uint64_t start;
+	long long taken;
+	int ret, spooled, spooledlines;
+
+	while(sp->count > 0 && health_upload_due(&health)) {
+		/* the batch is taken from the spool again for every attempt, the
+		   lines of a failed one may have been dropped from the ring since */
+		spooled = spool_peek(sp, up->batch, budget.batch * LINE_LEN < UPLOAD_BATCH_SIZE ? budget.batch * LINE_LEN : UPLOAD_BATCH_SIZE, &spooledlines);
+		up->batchlen = spooled;
+		up->batchcount = spooledlines;
+
+		if(!upload_allowed(up, &taken)) {
+			METRIC_ADD(upload_deferred, 1);
+			break;		/* over the uplink budget, next round */
+		}
+
+		sent = up->sentbytes;
+		start = metrics_clock();
+		ret = upload_flush(up);
+		metrics_observe(&metrics->upload_rtt, start);
+		health_upload_result(&health, ret == UPLOAD_OK);
+		if(ret < 0) {
+			upload_refund(taken);
+			METRIC_ADD(upload_failures, 1);
+			printf("Error: upload_flush returned: %d (http %d), retry in %lds\n", ret, up->status, health.upload.backoff);
+			break;
+		}
+		printf("Uploaded batch, %lu bytes sent for %lu bytes of records\n", up->sentbytes, up->rawbytes);
+		spool_pop(sp, spooled, spooledlines);
+		METRIC_ADD(upload_batches, 1);
+		METRIC_ADD(upload_records, spooledlines);
+		METRIC_ADD(upload_raw_bytes, spooled);
+		METRIC_ADD(upload_sent_bytes, up->sentbytes - sent);
+
+		/* a partial batch is only sent when it is all there is */
+		if(sp->count < budget.batch)
+			break;
+	}
+	health.backlog = sp->count;
+	health.dropped = sp->dropped;
+	METRIC_SET(spool_depth, sp->count);
+	METRIC_SET(spool_dropped, sp->dropped);
+}
+
+/* set up the uploader from the current config */
+int open_uploader(UPLOADER *up)
+{
+	int ret;
+
+	ret = upload_init(up, conf.post_url, conf.post_user, conf.post_password,
+			  conf.post_cafile[0] ? conf.post_cafile : NULL);
 	if(ret < 0) {
-		printf("Error: SerialBlockRead returned: %d\n", ret);
-		SerialClose(fd);
+		printf("Error: upload_init returned: %d\n", ret);
+		return ret;
+	}
+	up->compress = conf.compress;
+	return 0;
+}
+
+/* adapt batching, compression and the image interval to the month's
+   traffic so far */
+void check_budget(UPLOADER *up)
+{
+	int level = budget.level;
+
+	budget.lastcheck = health_now();
+	if(budget_check(&budget, conf.budget_iface, conf.vnstat_dir, (uint64_t)conf.budget * 1024 * 1024,
+			conf.batch, conf.compress, conf.image_interval) < 0)
+		printf("Error: unable to read the vnstat database of %s in %s\n", conf.budget_iface, conf.vnstat_dir);
+	else if(budget.level != level)
+		printf("Budget level %d, %lluM used, %lluM projected of %dM, batch %d, images every %ds\n",
+		       budget.level, (unsigned long long)(budget.used >> 20), (unsigned long long)(budget.projected >> 20),
+		       conf.budget, budget.batch, budget.imageinterval);
+
+	up->compress = budget.compress;
+	METRIC_SET(budget_level, budget.level);
+	METRIC_SET(budget_used_mb, budget.used >> 20);
+	METRIC_SET(budget_projected_mb, budget.projected >> 20);
+	METRIC_SET(batch, budget.batch);
+	METRIC_SET(image_interval, budget.imageinterval);
+}
+
+/* reread the config file on SIGHUP. The serial port and the uploader are
+   only reopened when their settings changed, spooled records are kept */
+void reload_config(const char *file, int *fd, UPLOADER *up)
+{
+	CONFIG old = conf;
+
+	if(config_load(&conf, file) < 0) {
+		printf("Error: %s not reloaded, keeping the running config\n", file);
+		return;
+	}
+	printf("Reloaded %s\n", file);
+
+	health.stale = conf.serial_stale;
+	health.maxerrors = conf.max_errors;
+	if(conf.spool_size != old.spool_size)
+		printf("Warning: SpoolSize is only read at startup\n");
+	conf.spool_size = old.spool_size;
+
+	if(strcmp(conf.device, old.device) != 0 || conf.port != old.port ||
+	   strcmp(conf.station, old.station) != 0) {
+		SerialClose(*fd);
+		*fd = conf.port;
+		health_serial_result(&health, open_station(*fd) == 0);
+		METRIC_ADD(reopens, 1);
+	}
+	else if(conf.baud != old.baud && FindFD(*fd) >= 0) {
+		if(SerialSetSpeed(*fd, conf.baud) < 0)
+			printf("Error: SerialSetSpeed %d failed\n", conf.baud);
+	}
+
+	if(strcmp(conf.post_url, old.post_url) != 0 ||
+	   strcmp(conf.post_user, old.post_user) != 0 ||
+	   strcmp(conf.post_password, old.post_password) != 0 ||
+	   strcmp(conf.post_cafile, old.post_cafile) != 0) {
+		/* the uploader holds pointers into itself (zlib, TLS session
+		   callback) so it is set up in place, the pending batch is
+		   refilled from the spool for the new endpoint */
+		upload_close(up);
+		if(open_uploader(up) < 0) {
+			printf("Error: keeping the old upload endpoint\n");
+			strcpy(conf.post_url, old.post_url);
+			strcpy(conf.post_user, old.post_user);
+			strcpy(conf.post_password, old.post_password);
+			strcpy(conf.post_cafile, old.post_cafile);
+			open_uploader(up);
+		}
+		health.upload.nextretry = 0;
+	}
+	check_budget(up);
+}
+
+int print_latest(void)
+{
+	LATEST *l = latest_attach();
+	LATESTDATA d;
+
+	if(l == NULL || latest_read(l, &d) < 0) {
+		printf("Error: no observation, is getwind running?\n");
+		latest_detach(l);
 		return -1;
 	}
+	latest_detach(l);
+
+	printf("samples=%u\n", d.samples);
+	printf("age=%.3f\n", (clock_ns(CLOCK_MONOTONIC) - d.monotonic) / 1e9);
+	if(d.flags & LATEST_SPEED)
+		printf("speed=%.1f\n", d.speed);
+	if(d.flags & LATEST_DIRECTION)
+		printf("direction=%d\n", d.direction);
+	if(d.flags & LATEST_TEMPERATURE)
+		printf("temperature=%.1f\n", d.temperature);
+	if(d.flags & LATEST_AVGSPEED)
+		printf("avgspeed=%.1f\n", d.avgspeed);
+	if(d.flags & LATEST_GUST)
+		printf("gust=%.1f\n", d.gust);
+	if(d.qc)
+		printf("qc=%x\n", d.qc);
+	printf("speed1=%.1f gust1=%.1f\n", d.speed1, d.gust1);
+	printf("speed10=%.1f gust10=%.1f direction10=%d temperature10=%.1f..%.1f samples10=%u\n",
+	       d.speed10, d.gust10, d.direction10, d.tempmin10, d.tempmax10, d.samples10);
+	return 0;
+}
 
-	printf("Found\n");		
-       	for(i=0;i<48;i++) {
-                printf("%c\n", buf[i]);
+int main(int argc, char *argv[])
+{
+	OBSERVATION obs;
+	AGGREGATE agg;
+	char body[255];
+	int ret, fd;
+	const char *conffile = CONFIG_FILE;
+	long laststatus;
+	UPLOADER up;
+	SPOOL spool;
+
+	/* getwind -m prints the metrics of the running instance */
+	if(argc > 1 && strcmp(argv[1], "-m") == 0) {
+		if(metrics_dump(stdout) < 0) {
+			printf("Error: no metrics, is getwind running?\n");
+			return -1;
+		}
+		return 0;
 	}
-	
-	if((buf[48] != 13) && (buf[49] != 10)) {
-		printf("Error: End of data incorrect!\n");
+	/* getwind -l prints the latest observation of the running instance */
+	if(argc > 1 && strcmp(argv[1], "-l") == 0)
+		return print_latest();
+	if(argc > 2 && strcmp(argv[1], "-c") == 0)
+		conffile = argv[2];
+	else if(argc > 1) {
+		printf("Usage: getwind [-c configfile | -m | -l]\n");
+		return -1;
+	}
+
+	ret = config_load(&conf, conffile);
+	if(ret < 0)
+		return -1;
+	printf("%s %s\n", ret ? "Using config" : "No config, using defaults instead of", conffile);
+	fd = conf.port;
+
+	health_init(&health);
+	health.stale = conf.serial_stale;
+	health.maxerrors = conf.max_errors;
+	if(metrics_init() < 0)
+		printf("Warning: unable to create %s, metrics are not exported\n", METRICS_NAME);
+	if(latest_init() < 0)
+		printf("Warning: unable to create %s, observations are not shared\n", LATEST_NAME);
+
+	if(open_station(fd) < 0)
+		return -1;
+
+	printf("Setting up uploader...");
+	if(open_uploader(&up) < 0 || spool_init(&spool, conf.spool_size) < 0) {
 		SerialClose(fd);
 		return -1;
-	}	
+	}
+	ret = spool_load(&spool, conf.spool_file);
+	printf("Done, %d spooled records\n", ret);
+	budget_init(&budget, conf.batch, conf.compress, conf.image_interval);
+	check_budget(&up);
 
-	//printf("end= %d %d\n", buf[48], buf[49]);
+	signal(SIGINT, sighandler);
+	signal(SIGTERM, sighandler);
+	signal(SIGUSR1, sighandler);
+	signal(SIGHUP, sighandler);
+	signal(SIGPIPE, SIG_IGN);
+	/* a fresh status file right away, run-getwind.sh judges its age */
+	health_write(&health, conf.status_file);
+	laststatus = health_now();
+	agg.count = 0;
+	qc_init(&qc);
+
+	while(running) {
+		if(reload) {
+			reload = 0;
+			reload_config(conffile, &fd, &up);
+		}
+
+		if(health_serial_check(&health)) {
+			printf("Serial input failed, reopening port\n");
+			SerialClose(fd);
+			health_serial_result(&health, open_station(fd) == 0);
+			METRIC_ADD(reopens, 1);
+		}
+
+		if(FindFD(fd) < 0) {
+			sleep(1);	/* port closed, waiting for the next reopen */
+			ret = 0;
+		}
+		else {
+			ret = get_observation(fd, &obs, 1000);
+		}
+
+		if(ret < 0) {
+			/* port gone, the health check reopens it */
+			printf("Error: SerialBlockRead returned: %d\n", ret);
+			SerialClose(fd);
+			health_serial_lost(&health);
+		}
+		else if(ret > 0) {
+			if(conf.qc && qc_filter(&qc, &obs)) {
+				printf("Quality control removed fields, flags %x\n", obs.qc);
+				METRIC_ADD(qc_rejected, 1);
+			}
+			latest_publish(&obs);
+			station_aggregate_add(&agg, &obs, health_now());
+		}
+
+		/* one observation per interval, gusts come from every sample */
+		if(agg.count > 0 && health_now() - agg.start >= conf.interval) {
+			station_aggregate_take(&agg, &obs);
+			ret = station_format(&obs, body, sizeof(body));
+			printf("%s\n", body);
+			spool_push(&spool, body, ret);
+			METRIC_SET(updated, time(NULL));
+			METRIC_SET(spool_depth, spool.count);
+			METRIC_SET(spool_dropped, spool.dropped);
+		}
+
+		if(health_now() - budget.lastcheck >= BUDGET_CHECK)
+			check_budget(&up);
+
+		if(spool.count >= budget.batch)
+			upload_spool(&up, &spool);
+
+		if(dumpstatus || health_now() - laststatus >= conf.status_interval) {
+			if(dumpstatus)
+				health_print(&health, stdout);
+			health_write(&health, conf.status_file);
+			laststatus = health_now();
+			dumpstatus = 0;
+		}
+	}
 
-	ret = SerialWrite(fd, ">\r", 2);
+	printf("Exiting, uploading %d spooled records\n", spool.count);
+	if(framer.drv && framer.drv->init)
+		SerialWrite(fd, ">\r", 2);	/* leave the logging mode */
 	SerialClose(fd);
 
-	speed = (float)get_value(buf, SPEED_OFFSET);
-	speed = speed / 10;
-	speed = speed / 3.6; //(speed * 1.60934) / 3.6;
-	direction = get_value(buf, DIRECTION_OFFSET) & 0x00FFFFFF; // highest byte may be FF sometimes
-	direction = (int)((360.0/255.0) * direction);
-	temperature = (float)get_value(buf, TEMPERATURE_OFFSET);
-	temperature = temperature / 10;
-	temperature = (temperature - 32) * 5 / 9;
-	avgspeed = (float)get_value(buf, AVGSPEED_OFFSET);
-	avgspeed = avgspeed / 10;
-	avgspeed = avgspeed / 3.6;
-
-	printf("speed=%.1f, direction=%d, temperature=%.1f, avg.speed=%.1f\n", speed, direction, temperature, avgspeed);
-	sprintf(buf, "wget --spider \"%s?speed=%.1f&dir=%d&temp=%.1f&avgspeed=%.1f\"\n", POST_URL, speed, direction, temperature, avgspeed);
-
-	system(buf);
+	/* one last try, whatever is left is saved for the next start */
+	health.upload.nextretry = 0;
+	upload_spool(&up, &spool);
+	if(spool.count > 0 && spool_save(&spool, conf.spool_file) < 0)
+		printf("Error: unable to save %d records to %s\n", spool.count, conf.spool_file);
+	health.backlog = spool.count;
+	health_write(&health, conf.status_file);
+	upload_close(&up);
+	spool_free(&spool);
+	RateClose(rate);
+	latest_close();
+	metrics_close();
 	
 	return 0;
 }
@@ -0,0 +1,195 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		health.c
+  @brief	health tracking and recovery decisions for getwind
+
+  Each stage (serial input, upload) is OK, DEGRADED or FAILED. The serial
+  stage fails when no record has arrived for HEALTH_SERIAL_STALE seconds or
+  when most of the input in the last HEALTH_WINDOW fails framing, and is
+  then reopened. Failed uploads are retried with exponential backoff while
+  observations wait in the spool. This replaces killing and restarting
+  getwind from run-getwind.sh.
+ */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "health.h"
+
+static const char *state_name[] = { "ok", "degraded", "failed" };
+
+/* seconds of CLOCK_MONOTONIC, not affected by clock changes */
+long health_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static void stage_set(STAGE *st, int state, long now)
+{
+	if(st->state == state)
+		return;
+	if(state == HEALTH_OK)
+		st->recoveries++;
+	st->state = state;
+	st->since = now;
+}
+
+/* a failed attempt, the next one waits twice as long as the last */
+static void stage_fail(STAGE *st, int state, long now)
+{
+	st->failures++;
+	st->errors++;
+	st->backoff = st->backoff ? st->backoff * 2 : HEALTH_BACKOFF_MIN;
+	if(st->backoff > HEALTH_BACKOFF_MAX)
+		st->backoff = HEALTH_BACKOFF_MAX;
+	st->nextretry = now + st->backoff;
+	stage_set(st, state, now);
+}
+
+static void stage_ok(STAGE *st, long now)
+{
+	st->failures = 0;
+	st->backoff = 0;
+	st->nextretry = 0;
+	stage_set(st, HEALTH_OK, now);
+}
+
+void health_init(HEALTH *h)
+{
+	memset(h, 0, sizeof(HEALTH));
+	h->started = h->lastrecord = h->windowstart = health_now();
+	h->serial.since = h->upload.since = h->started;
+	h->stale = HEALTH_SERIAL_STALE;
+	h->maxerrors = HEALTH_MAX_ERRORS;
+}
+
+/* a record was framed (ok) or failed framing */
+void health_record(HEALTH *h, int ok)
+{
+	long now = health_now();
+
+	if(now - h->windowstart >= HEALTH_WINDOW) {
+		h->windowstart = now;
+		h->windowrecords = h->windowerrors = 0;
+	}
+
+	if(ok) {
+		h->records++;
+		h->windowrecords++;
+		h->lastrecord = now;
+		if(h->windowerrors < h->maxerrors)
+			stage_ok(&h->serial, now);
+	}
+	else {
+		h->framingerrors++;
+		h->windowerrors++;
+		h->serial.errors++;
+		if(h->serial.state == HEALTH_OK)
+			stage_set(&h->serial, HEALTH_DEGRADED, now);
+	}
+}
+
+/* returns 1 when the serial port should be reopened now */
+int health_serial_check(HEALTH *h)
+{
+	long now = health_now();
+
+	if(h->serial.state != HEALTH_FAILED) {
+		if(now - h->lastrecord >= h->stale ||
+		   (h->windowerrors >= h->maxerrors && h->windowerrors > h->windowrecords)) {
+			stage_fail(&h->serial, HEALTH_FAILED, now);
+			h->serial.nextretry = now;	/* first reopen right away */
+			h->windowrecords = h->windowerrors = 0;
+			h->windowstart = now;
+		}
+		else {
+			return 0;
+		}
+	}
+
+	return now >= h->serial.nextretry;
+}
+
+/* outcome of reopening the serial port. a successful reopen stays FAILED
+   until a record arrives, but the stale timer starts over */
+void health_serial_result(HEALTH *h, int ok)
+{
+	long now = health_now();
+
+	h->reopens++;
+	if(ok) {
+		h->lastrecord = now;
+		h->serial.state = HEALTH_DEGRADED;
+		h->serial.since = now;
+	}
+	else {
+		stage_fail(&h->serial, HEALTH_FAILED, now);
+	}
+}
+
+/* the port failed or went away, reopen right away the first time */
+void health_serial_lost(HEALTH *h)
+{
+	long now = health_now();
+
+	stage_fail(&h->serial, HEALTH_FAILED, now);
+	if(h->serial.failures == 1)
+		h->serial.nextretry = now;
+}
+
+int health_upload_due(HEALTH *h)
+{
+	return health_now() >= h->upload.nextretry;
+}
+
+void health_upload_result(HEALTH *h, int ok)
+{
+	long now = health_now();
+
+	if(ok)
+		stage_ok(&h->upload, now);
+	else
+		stage_fail(&h->upload, h->upload.failures + 1 >= HEALTH_UPLOAD_FAILED ? HEALTH_FAILED : HEALTH_DEGRADED, now);
+}
+
+void health_print(HEALTH *h, FILE *fp)
+{
+	long now = health_now();
+
+	fprintf(fp, "uptime=%ld\n", now - h->started);
+	fprintf(fp, "serial.state=%s\n", state_name[h->serial.state]);
+	fprintf(fp, "serial.since=%ld\n", now - h->serial.since);
+	fprintf(fp, "serial.record_age=%ld\n", now - h->lastrecord);
+	fprintf(fp, "serial.records=%lu\n", h->records);
+	fprintf(fp, "serial.framing_errors=%lu\n", h->framingerrors);
+	fprintf(fp, "serial.window_errors=%d/%d\n", h->windowerrors, h->windowrecords + h->windowerrors);
+	fprintf(fp, "serial.reopens=%lu\n", h->reopens);
+	fprintf(fp, "serial.recoveries=%lu\n", h->serial.recoveries);
+	fprintf(fp, "upload.state=%s\n", state_name[h->upload.state]);
+	fprintf(fp, "upload.since=%ld\n", now - h->upload.since);
+	fprintf(fp, "upload.failures=%d\n", h->upload.failures);
+	fprintf(fp, "upload.errors=%lu\n", h->upload.errors);
+	fprintf(fp, "upload.backoff=%ld\n", h->upload.backoff);
+	fprintf(fp, "upload.recoveries=%lu\n", h->upload.recoveries);
+	fprintf(fp, "spool.backlog=%d\n", h->backlog);
+	fprintf(fp, "spool.dropped=%lu\n", h->dropped);
+}
+
+/* write status through a temporary file so readers never see half of it */
+int health_write(HEALTH *h, const char *file)
+{
+	char tmp[256];
+	FILE *fp;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+	if((fp = fopen(tmp, "w")) == NULL)
+		return -1;
+	health_print(h, fp);
+	if(fclose(fp) != 0)
+		return -1;
+	return rename(tmp, file);
+}
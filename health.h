@@ -0,0 +1,69 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		health.h
+  @brief	health tracking and recovery decisions for getwind
+
+  Each stage (serial input, upload) is OK, DEGRADED or FAILED. The serial
+  stage fails when no record has arrived for HEALTH_SERIAL_STALE seconds or
+  when most of the input in the last HEALTH_WINDOW fails framing, and is
+  then reopened. Failed uploads are retried with exponential backoff while
+  observations wait in the spool. This replaces killing and restarting
+  getwind from run-getwind.sh.
+ */
+/*---------------------------------------------------------------------------*/
+
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <stdio.h>
+
+#define HEALTH_OK 0
+#define HEALTH_DEGRADED 1
+#define HEALTH_FAILED 2
+
+#define HEALTH_SERIAL_STALE 30	/* s without a record before the port is reopened */
+#define HEALTH_WINDOW 60	/* s, error rate window */
+#define HEALTH_MAX_ERRORS 10	/* framing errors per window before the port is reopened */
+#define HEALTH_BACKOFF_MIN 2	/* s, first retry delay */
+#define HEALTH_BACKOFF_MAX 300	/* s, longest retry delay */
+#define HEALTH_UPLOAD_FAILED 5	/* consecutive upload failures before FAILED */
+
+typedef struct {
+	int state;
+	long since;		/* when state was entered */
+	int failures;		/* consecutive failures */
+	long backoff;		/* current retry delay */
+	long nextretry;		/* no retry before this time */
+	unsigned long errors;	/* total failures */
+	unsigned long recoveries;	/* FAILED/DEGRADED -> OK transitions */
+} STAGE;
+
+typedef struct {
+	STAGE serial;
+	STAGE upload;
+	long started;
+	long lastrecord;
+	unsigned long records;
+	unsigned long framingerrors;
+	unsigned long reopens;
+	long windowstart;
+	int windowrecords;
+	int windowerrors;
+	int backlog;		/* lines waiting in the spool */
+	unsigned long dropped;	/* lines dropped from the spool */
+	int stale;		/* HEALTH_SERIAL_STALE unless configured */
+	int maxerrors;		/* HEALTH_MAX_ERRORS unless configured */
+} HEALTH;
+
+long health_now(void);
+void health_init(HEALTH *h);
+void health_record(HEALTH *h, int ok);
+int health_serial_check(HEALTH *h);
+void health_serial_result(HEALTH *h, int ok);
+void health_serial_lost(HEALTH *h);
+int health_upload_due(HEALTH *h);
+void health_upload_result(HEALTH *h, int ok);
+void health_print(HEALTH *h, FILE *fp);
+int health_write(HEALTH *h, const char *file);
+
+#endif
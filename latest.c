@@ -0,0 +1,168 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		latest.c
+  @brief	latest observation in shared memory for local readers
+
+  Writer side of latest.h. Rolling statistics are kept in one bucket per
+  minute of the monotonic clock, LATEST_MINUTES of them in a ring, so a
+  sample costs a bucket update and a pass over the ring whatever the rate.
+  The 1 minute figures are the current minute's bucket.
+ */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "latest.h"
+#include "station.h"
+
+typedef struct {
+	uint64_t minute;	/* monotonic minute of the bucket */
+	uint32_t samples;
+	double speedsum;
+	uint32_t speedcount;
+	float gust;
+	double dirx, diry;
+	uint32_t dircount;
+	float tempmin, tempmax;
+	uint32_t tempcount;
+} MINUTE;
+
+static LATEST *latest = NULL;
+static MINUTE minutes[LATEST_MINUTES];
+static uint32_t samples;
+
+int latest_init(void)
+{
+	LATEST *l;
+	int fd;
+
+	memset(minutes, 0, sizeof(minutes));
+	samples = 0;
+
+	fd = shm_open(LATEST_NAME, O_RDWR | O_CREAT, 0644);
+	if(fd < 0)
+		return -1;
+	if(ftruncate(fd, sizeof(LATEST)) < 0) {
+		close(fd);
+		return -1;
+	}
+	l = mmap(NULL, sizeof(LATEST), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(l == MAP_FAILED)
+		return -1;
+
+	/* readers check magic and size, so they go last */
+	memset(&l->data, 0, sizeof(l->data));
+	l->data.direction10 = -1;
+	l->pid = getpid();
+	__atomic_store_n(&l->seq, 0, __ATOMIC_RELAXED);
+	l->size = sizeof(LATEST);
+	__atomic_store_n(&l->magic, LATEST_MAGIC, __ATOMIC_RELEASE);
+	latest = l;
+	return 0;
+}
+
+static void minute_add(MINUTE *m, const OBSERVATION *obs)
+{
+	double rad;
+
+	m->samples++;
+	if(obs->flags & OBS_SPEED) {
+		m->speedsum += obs->speed;
+		m->speedcount++;
+		if(obs->speed > m->gust)
+			m->gust = obs->speed;
+	}
+	if((obs->flags & OBS_GUST) && obs->gust > m->gust)
+		m->gust = obs->gust;
+	if(obs->flags & OBS_DIRECTION) {
+		rad = obs->direction * (M_PI / 180.0);
+		m->dirx += sin(rad);
+		m->diry += cos(rad);
+		m->dircount++;
+	}
+	if(obs->flags & OBS_TEMPERATURE) {
+		if(m->tempcount == 0 || obs->temperature < m->tempmin)
+			m->tempmin = obs->temperature;
+		if(m->tempcount == 0 || obs->temperature > m->tempmax)
+			m->tempmax = obs->temperature;
+		m->tempcount++;
+	}
+}
+
+/* publish a sample that passed quality control */
+void latest_publish(const OBSERVATION *obs)
+{
+	LATESTDATA d;
+	MINUTE *m, *cur;
+	uint64_t minute = obs->monotonic / 60000000000ULL;
+	double speedsum = 0, dirx = 0, diry = 0;
+	uint32_t speedcount = 0, dircount = 0, tempcount = 0;
+	int i, dir;
+
+	if(latest == NULL)
+		return;
+
+	cur = &minutes[minute % LATEST_MINUTES];
+	if(cur->minute != minute || cur->samples == 0) {
+		memset(cur, 0, sizeof(MINUTE));
+		cur->minute = minute;
+	}
+	minute_add(cur, obs);
+
+	memset(&d, 0, sizeof(d));
+	d.flags = obs->flags;
+	d.qc = obs->qc;
+	d.speed = obs->speed;
+	d.direction = obs->direction;
+	d.temperature = obs->temperature;
+	d.avgspeed = obs->avgspeed;
+	d.gust = obs->gust;
+	d.realtime = obs->realtime;
+	d.monotonic = obs->monotonic;
+	d.samples = ++samples;
+
+	for(i=0; i<LATEST_MINUTES; i++) {
+		m = &minutes[i];
+		if(m->samples == 0 || m->minute + LATEST_MINUTES <= minute)
+			continue;
+		d.samples10 += m->samples;
+		speedsum += m->speedsum;
+		speedcount += m->speedcount;
+		if(m->gust > d.gust10)
+			d.gust10 = m->gust;
+		dirx += m->dirx;
+		diry += m->diry;
+		dircount += m->dircount;
+		if(m->tempcount) {
+			if(tempcount == 0 || m->tempmin < d.tempmin10)
+				d.tempmin10 = m->tempmin;
+			if(tempcount == 0 || m->tempmax > d.tempmax10)
+				d.tempmax10 = m->tempmax;
+			tempcount += m->tempcount;
+		}
+	}
+	d.speed1 = cur->speedcount ? cur->speedsum / cur->speedcount : 0;
+	d.gust1 = cur->gust;
+	d.speed10 = speedcount ? speedsum / speedcount : 0;
+	d.direction10 = -1;
+	if(dircount) {
+		dir = (int)(atan2(dirx, diry) * (180.0 / M_PI) + 0.5);
+		d.direction10 = (dir + 360) % 360;
+	}
+
+	/* seq odd while the data changes, readers retry */
+	__atomic_store_n(&latest->seq, latest->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	latest->data = d;
+	__atomic_store_n(&latest->seq, latest->seq + 1, __ATOMIC_RELEASE);
+}
+
+void latest_close(void)
+{
+	if(latest) {
+		munmap(latest, sizeof(LATEST));
+		latest = NULL;
+	}
+}
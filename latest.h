@@ -0,0 +1,125 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		latest.h
+  @brief	latest observation in shared memory for local readers
+
+  getwind publishes every sample that passes quality control, together
+  with rolling 1 and 10 minute statistics, in the POSIX shared memory
+  segment /dev/shm/getwind.latest. The segment is protected by a sequence
+  lock: the writer makes seq odd while it updates the data and even when
+  it is done, readers copy the data and retry if seq was odd or changed.
+  Readers never block the writer and take well under a microsecond.
+
+  This header is all a reader needs (link with -lrt on older glibc):
+
+	LATEST *l = latest_attach();
+	LATESTDATA d;
+	if(l && latest_read(l, &d) == 0)
+		printf("%.1f m/s from %d\n", d.speed, d.direction);
+	latest_detach(l);
+ */
+/*---------------------------------------------------------------------------*/
+
+#ifndef LATEST_H
+#define LATEST_H
+
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#define LATEST_NAME "/getwind.latest"
+#define LATEST_MAGIC 0x314c5747	/* "GWL1" */
+#define LATEST_MINUTES 10	/* rolling statistics span */
+#define LATEST_RETRIES 1000	/* reads retried while the writer is busy */
+
+/* LATESTDATA.flags, as OBSERVATION.flags in station.h */
+#define LATEST_SPEED 0x01
+#define LATEST_DIRECTION 0x02
+#define LATEST_TEMPERATURE 0x04
+#define LATEST_AVGSPEED 0x08
+#define LATEST_GUST 0x10
+
+typedef struct {
+	/* latest sample */
+	uint32_t flags;		/* fields present in the sample */
+	uint32_t qc;		/* fields removed by quality control */
+	float speed;		/* m/s */
+	int32_t direction;	/* degrees */
+	float temperature;	/* degrees C */
+	float avgspeed;		/* m/s, station's 1 minute average */
+	float gust;		/* m/s, station's peak, if it sends one */
+	uint64_t realtime;	/* CLOCK_REALTIME ns the sample arrived */
+	uint64_t monotonic;	/* CLOCK_MONOTONIC ns, same moment */
+	uint32_t samples;	/* samples published since getwind started */
+
+	/* rolling statistics of the samples in the last 1 and 10 minutes */
+	uint32_t samples10;
+	float speed1;		/* mean speed */
+	float speed10;
+	float gust1;		/* highest speed sample */
+	float gust10;
+	int32_t direction10;	/* mean direction, -1 = none */
+	float tempmin10;
+	float tempmax10;
+} LATESTDATA;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t size;		/* sizeof(LATEST), layout check */
+	uint32_t pid;		/* of the writer */
+	uint32_t seq;		/* odd while the writer updates data */
+	LATESTDATA data;
+} LATEST;
+
+/* map the segment read only, NULL if getwind isn't publishing */
+static inline LATEST *latest_attach(void)
+{
+	LATEST *l;
+	int fd;
+
+	fd = shm_open(LATEST_NAME, O_RDONLY, 0);
+	if(fd < 0)
+		return NULL;
+	l = (LATEST *)mmap(NULL, sizeof(LATEST), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(l == MAP_FAILED)
+		return NULL;
+	if(l->magic != LATEST_MAGIC || l->size != sizeof(LATEST)) {
+		munmap(l, sizeof(LATEST));
+		return NULL;
+	}
+	return l;
+}
+
+static inline void latest_detach(LATEST *l)
+{
+	if(l)
+		munmap(l, sizeof(LATEST));
+}
+
+/* consistent copy of the data, 0 on success, -1 if the writer kept it busy */
+static inline int latest_read(const LATEST *l, LATESTDATA *out)
+{
+	uint32_t seq;
+	int i;
+
+	for(i=0; i<LATEST_RETRIES; i++) {
+		seq = __atomic_load_n(&l->seq, __ATOMIC_ACQUIRE);
+		if(seq & 1)
+			continue;
+		*out = l->data;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&l->seq, __ATOMIC_RELAXED) == seq)
+			return 0;
+	}
+	return -1;
+}
+
+/* writer side, getwind only */
+struct observation;
+int latest_init(void);
+void latest_publish(const struct observation *obs);
+void latest_close(void);
+
+#endif
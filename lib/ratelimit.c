@@ -0,0 +1,343 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		ratelimit.c
+  @brief	uplink rate control API define file
+
+  Token buckets in a POSIX shared memory segment, consulted by every
+  process that sends over the uplink before it sends. Buckets are refilled
+  lazily from CLOCK_MONOTONIC when they are used, under a robust process
+  shared mutex so a client killed while holding it doesn't stop the others.
+
+ */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ratelimit.h"
+
+static uint64_t	RateNow( void)
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void	RateLock( RATELIMIT *rl)
+{
+	if( pthread_mutex_lock( &rl->lock) == EOWNERDEAD)
+		pthread_mutex_consistent( &rl->lock);	///< holder died, buckets are still sane
+}
+
+static void	RateUnlock( RATELIMIT *rl)
+{
+	pthread_mutex_unlock( &rl->lock);
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	add the tokens earned since the last refill
+  @param	b		bucket
+  @param	now		CLOCK_MONOTONIC ns
+ */
+/*---------------------------------------------------------------------------*/
+static void	RateRefill( RATEBUCKET *b, uint64_t now)
+{
+	if( b->rate > 0 && now > b->last)
+	{
+		b->tokens+= (int64_t)((now - b->last) * b->rate / 1000000000);
+		if( b->tokens > b->burst)
+			b->tokens= b->burst;
+	}
+	b->last= now;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	ms until a bucket holds need tokens
+  @param	b		bucket
+  @param	need		tokens wanted
+  @return	0 if they are there now
+ */
+/*---------------------------------------------------------------------------*/
+static int	RateDelay( RATEBUCKET *b, int64_t need)
+{
+	if( b->rate <= 0 || b->tokens >= need)
+		return 0;
+	return (int)((need - b->tokens) * 1000 / b->rate) + 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	open the rate control segment
+  @param	create		create and initialize it (unlimited) if it doesn't exist
+  @return	the segment, NULL if it doesn't exist or can't be mapped
+ */
+/*---------------------------------------------------------------------------*/
+RATELIMIT	*RateOpen( int create)
+{
+	RATELIMIT *rl;
+	pthread_mutexattr_t attr;
+	int fd, fresh= 0, i;
+
+	fd= create ? shm_open( RATE_NAME, O_RDWR|O_CREAT|O_EXCL, 0666) : -1;
+	if( fd >= 0)
+	{
+		fresh= 1;
+		fchmod( fd, 0666);		///< every uplink user may take tokens
+		if( ftruncate( fd, sizeof(RATELIMIT)) < 0)
+		{
+			close( fd);
+			shm_unlink( RATE_NAME);
+			return NULL;
+		}
+	}
+	else
+	{
+		fd= shm_open( RATE_NAME, O_RDWR, 0);
+		if( fd < 0)
+			return NULL;
+	}
+
+	rl= mmap( NULL, sizeof(RATELIMIT), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close( fd);
+	if( rl == MAP_FAILED)
+		return NULL;
+
+	if( fresh)
+	{
+		pthread_mutexattr_init( &attr);
+		pthread_mutexattr_setpshared( &attr, PTHREAD_PROCESS_SHARED);
+		pthread_mutexattr_setrobust( &attr, PTHREAD_MUTEX_ROBUST);
+		pthread_mutex_init( &rl->lock, &attr);
+		pthread_mutexattr_destroy( &attr);
+		rl->size= sizeof(RATELIMIT);
+		__atomic_store_n( &rl->magic, RATE_MAGIC, __ATOMIC_RELEASE);
+		return rl;
+	}
+
+	/* wait briefly for a concurrent creator */
+	for( i= 0; i < 100 && __atomic_load_n( &rl->magic, __ATOMIC_ACQUIRE) != RATE_MAGIC; i++)
+		usleep( 1000);
+	if( rl->magic != RATE_MAGIC || rl->size != sizeof(RATELIMIT))
+	{
+		munmap( rl, sizeof(RATELIMIT));
+		return NULL;
+	}
+	return rl;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	unmap the rate control segment
+  @param	rl		segment from RateOpen(), may be NULL
+ */
+/*---------------------------------------------------------------------------*/
+void	RateClose( RATELIMIT *rl)
+{
+	if( rl)
+		munmap( rl, sizeof(RATELIMIT));
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	set the link bucket
+  @param	rl		segment
+  @param	rate		bytes per second for all clients, 0 = unlimited
+  @param	burst		bucket size in bytes
+  @param	reserve		bytes of the bucket kept for high priority clients
+ */
+/*---------------------------------------------------------------------------*/
+void	RateSetLink( RATELIMIT *rl, int64_t rate, int64_t burst, int64_t reserve)
+{
+	RateLock( rl);
+	rl->link.rate= rate;
+	rl->link.burst= burst > 0 ? burst : 1;
+	rl->link.tokens= rl->link.burst;
+	rl->link.last= RateNow();
+	rl->reserve= reserve < rl->link.burst ? reserve : rl->link.burst - 1;
+	RateUnlock( rl);
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	add or change a client
+  @param	rl		segment
+  @param	name		client name
+  @param	priority	RATE_PRIO_HIGH or RATE_PRIO_BULK
+  @param	rate		bytes per second for this client, 0 = only the link limits it
+  @param	burst		bucket size in bytes
+  @return	client number for success, on error return error code
+ */
+/*---------------------------------------------------------------------------*/
+int	RateSetClient( RATELIMIT *rl, const char *name, int priority, int64_t rate, int64_t burst)
+{
+	int i, slot= RATE_ERROR_FULL;
+
+	RateLock( rl);
+	for( i= RATE_MAX_CLIENTS - 1; i >= 0; i--)
+	{
+		if( strncmp( rl->client[ i].name, name, RATE_NAME_LEN) == 0)
+		{
+			slot= i;
+			break;
+		}
+		if( rl->client[ i].name[ 0] == '\0')
+			slot= i;
+	}
+	if( slot >= 0)
+	{
+		strncpy( rl->client[ slot].name, name, RATE_NAME_LEN - 1);
+		rl->client[ slot].priority= priority;
+		rl->client[ slot].bucket.rate= rate;
+		rl->client[ slot].bucket.burst= burst > 0 ? burst : 1;
+		rl->client[ slot].bucket.tokens= rl->client[ slot].bucket.burst;
+		rl->client[ slot].bucket.last= RateNow();
+	}
+	RateUnlock( rl);
+
+	return slot;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	look up a client by name
+  @param	rl		segment
+  @param	name		client name
+  @return	client number, RATE_ERROR_CLIENT if there is none
+ */
+/*---------------------------------------------------------------------------*/
+int	RateFindClient( RATELIMIT *rl, const char *name)
+{
+	int i;
+
+	for( i= 0; i < RATE_MAX_CLIENTS; i++)
+		if( rl->client[ i].name[ 0] && strncmp( rl->client[ i].name, name, RATE_NAME_LEN) == 0)
+			return i;
+
+	return RATE_ERROR_CLIENT;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	take tokens for a send if they are there
+  @param	rl		segment
+  @param	client		client number
+  @param	bytes		size of the send
+  @return	RATE_OK when the send may go now, otherwise ms to wait before
+  		asking again, on error return error code
+
+  A send larger than a bucket is granted when the bucket is full and
+  leaves it in debt, so it delays the next sends instead of never going.
+ */
+/*---------------------------------------------------------------------------*/
+int	RateTake( RATELIMIT *rl, int client, int64_t bytes)
+{
+	RATECLIENT *c;
+	uint64_t now= RateNow();
+	int64_t reserve, need;
+	int delay, linkdelay;
+
+	if( client < 0 || client >= RATE_MAX_CLIENTS || rl->client[ client].name[ 0] == '\0')
+		return RATE_ERROR_CLIENT;
+	c= &rl->client[ client];
+
+	RateLock( rl);
+	RateRefill( &c->bucket, now);
+	RateRefill( &rl->link, now);
+
+	need= bytes < c->bucket.burst ? bytes : c->bucket.burst;
+	delay= RateDelay( &c->bucket, need);
+
+	reserve= c->priority == RATE_PRIO_HIGH ? 0 : rl->reserve;
+	need= bytes < rl->link.burst - reserve ? bytes : rl->link.burst - reserve;
+	linkdelay= RateDelay( &rl->link, need + reserve);
+	if( linkdelay > delay)
+		delay= linkdelay;
+
+	if( delay == 0)
+	{
+		if( c->bucket.rate > 0)
+			c->bucket.tokens-= bytes;
+		if( rl->link.rate > 0)
+			rl->link.tokens-= bytes;
+		c->sent+= bytes;
+	}
+	else
+		c->waits++;
+	RateUnlock( rl);
+
+	return delay;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	give back tokens taken for a send that did not go out
+  @param	rl		segment
+  @param	client		client number
+  @param	bytes		tokens taken by RateTake() for the send
+  @return	return RATE_OK for success, on error return error code
+
+  Buckets are not filled past their burst, so a refund never lets a
+  client send more at once than it could before the failed send.
+ */
+/*---------------------------------------------------------------------------*/
+int	RateGive( RATELIMIT *rl, int client, int64_t bytes)
+{
+	RATECLIENT *c;
+
+	if( client < 0 || client >= RATE_MAX_CLIENTS || rl->client[ client].name[ 0] == '\0')
+		return RATE_ERROR_CLIENT;
+	c= &rl->client[ client];
+
+	RateLock( rl);
+	if( c->bucket.rate > 0)
+	{
+		c->bucket.tokens+= bytes;
+		if( c->bucket.tokens > c->bucket.burst)
+			c->bucket.tokens= c->bucket.burst;
+	}
+	if( rl->link.rate > 0)
+	{
+		rl->link.tokens+= bytes;
+		if( rl->link.tokens > rl->link.burst)
+			rl->link.tokens= rl->link.burst;
+	}
+	c->sent-= bytes < (int64_t)c->sent ? (uint64_t)bytes : c->sent;
+	RateUnlock( rl);
+
+	return RATE_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	wait until tokens for a send are taken
+  @param	rl		segment
+  @param	client		client number
+  @param	bytes		size of the send
+  @param	timeout		ms to wait at most, -1 = no limit
+  @return	return RATE_OK for success, on error return error code
+ */
+/*---------------------------------------------------------------------------*/
+int	RateWait( RATELIMIT *rl, int client, int64_t bytes, int timeout)
+{
+	int delay;
+
+	while( (delay= RateTake( rl, client, bytes)) > 0)
+	{
+		if( timeout >= 0 && delay > timeout)
+			return RATE_ERROR_TIMEOUT;
+		usleep( delay * 1000);
+		if( timeout >= 0)
+			timeout-= delay;
+	}
+
+	return delay;
+}
@@ -0,0 +1,72 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		ratelimit.h
+  @brief	uplink rate control API header file
+
+  Token buckets in a POSIX shared memory segment, consulted by every
+  process that sends over the uplink before it sends. The link has one
+  bucket, each client has its own as well, and a send needs tokens in
+  both. Bulk clients may not take the link bucket below its reserve, so
+  high priority clients (wind updates) always find tokens while bulk
+  transfers (camera images) wait, and the bulk transfer is preempted at
+  its next chunk.
+
+  Clients that are not registered, or a missing segment, are not limited.
+
+ */
+/*---------------------------------------------------------------------------*/
+
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define RATE_NAME				"/uplink.rate"
+#define RATE_MAGIC				0x31524c55	///< "ULR1"
+#define RATE_MAX_CLIENTS			8
+#define RATE_NAME_LEN				16
+
+#define RATE_PRIO_HIGH				0	///< may use the link reserve
+#define RATE_PRIO_BULK				1	///< leaves the link reserve alone
+
+#define	RATE_OK					0
+#define RATE_ERROR_SHM				-1	///< Could not open or create the segment
+#define RATE_ERROR_FULL				-2	///< No free client slot
+#define RATE_ERROR_TIMEOUT			-3	///< Tokens not available in time
+#define RATE_ERROR_CLIENT			-4	///< No such client
+
+typedef struct {
+	int64_t		rate;		///< bytes per second, 0 = unlimited
+	int64_t		burst;		///< bucket size in bytes
+	int64_t		tokens;		///< bytes available, negative after an oversized send
+	uint64_t	last;		///< CLOCK_MONOTONIC ns of the last refill
+} RATEBUCKET;
+
+typedef struct {
+	char		name[ RATE_NAME_LEN];	///< empty slot if name[0] is 0
+	int		priority;
+	RATEBUCKET	bucket;
+	uint64_t	sent;		///< bytes granted
+	uint64_t	waits;		///< requests that had to wait
+} RATECLIENT;
+
+typedef struct {
+	uint32_t	magic;
+	uint32_t	size;		///< sizeof(RATELIMIT), layout check
+	pthread_mutex_t	lock;		///< process shared, robust
+	RATEBUCKET	link;
+	int64_t		reserve;	///< link tokens only high priority clients may take
+	RATECLIENT	client[ RATE_MAX_CLIENTS];
+} RATELIMIT;
+
+RATELIMIT	*RateOpen( int create);
+void	RateClose( RATELIMIT *rl);
+void	RateSetLink( RATELIMIT *rl, int64_t rate, int64_t burst, int64_t reserve);
+int	RateSetClient( RATELIMIT *rl, const char *name, int priority, int64_t rate, int64_t burst);
+int	RateFindClient( RATELIMIT *rl, const char *name);
+int	RateTake( RATELIMIT *rl, int client, int64_t bytes);
+int	RateGive( RATELIMIT *rl, int client, int64_t bytes);
+int	RateWait( RATELIMIT *rl, int client, int64_t bytes, int timeout);
+
+#endif
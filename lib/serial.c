@@ -32,12 +32,13 @@ static int	fd_map[ MAX_PORT_NUM]={ -1, -1, -1, -1, -1, -1, -1, -1};///< -1 means
 /**
   @brief	use port number to find out the fd of the port
   @param	port	port number
-  @return	fd which is opened by using SerialOpen()
+  @return	fd which is opened by using SerialOpen(), SERIAL_ERROR_FD if the
+		port isn't open or out of range
  */
 /*---------------------------------------------------------------------------*/
 int	FindFD( int port)
 {
-	if( fd_map[ port] == -1)
+	if( port < 0 || port >= MAX_PORT_NUM || fd_map[ port] == -1)
 		return SERIAL_ERROR_FD;
 
 	return fd_map[ port];
@@ -52,14 +53,30 @@ int	FindFD( int port)
 /*---------------------------------------------------------------------------*/
 int	SerialOpen( int port)
 {
-	int fd;
 	char device[ 80];
+
+	sprintf( device, "/dev/ttyM%d", port);
+	return SerialOpenDevice( port, device);
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	open a serial device by name and map it to a port number
+  @param	port		port number
+  @param	device		device path, e.g. /dev/ttyUSB0
+  @return	return fd for success, on error return error code
+ */
+/*---------------------------------------------------------------------------*/
+int	SerialOpenDevice( int port, const char *device)
+{
+	int fd;
 	struct termios tio;
 
+	if( port < 0 || port >= MAX_PORT_NUM)
+		return SERIAL_PARAMETER_ERROR;
 	if( fd_map[ port] != -1)		///< port already opened
 		return SERIAL_ERROR_OPEN;
 
-	sprintf( device, "/dev/ttyM%d", port);
 	fd = open( device, O_RDWR|O_NOCTTY);
 	if( fd <0)
 		return SERIAL_ERROR_OPEN;
@@ -117,7 +134,6 @@ int	SerialWrite( int port, char* str, int len)
 int	SerialNonBlockRead( int port, char* buf, int len)
 {
 	int res= 0;
-	int bytes= 0;
 	int fd= FindFD( port);
 
 	if( fd < 0)			///< error
@@ -141,7 +157,6 @@ int	SerialNonBlockRead( int port, char* buf, int len)
 int	SerialBlockRead( int port, char* buf, int len)
 {
 	int res= 0;
-	int bytes= 0;
 	int fd= FindFD( port);
 
 	if( fd < 0)			///< error
@@ -152,6 +167,36 @@ int	SerialBlockRead( int port, char* buf, int len)
 	return res;
 }
 
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	wait until data can be read from serial port
+  @param	port		port number
+  @param	timeout		timeout in ms, -1 waits forever
+  @return	return 1 if data is available, 0 on timeout,
+  		on error return error code
+ */
+/*---------------------------------------------------------------------------*/
+int	SerialWaitRead( int port, int timeout)
+{
+	struct timeval tv;
+	fd_set rfds;
+	int res;
+	int fd= FindFD( port);
+
+	if( fd < 0)			///< error
+		return fd;
+
+	FD_ZERO( &rfds);
+	FD_SET( fd, &rfds);
+	tv.tv_sec= timeout/ 1000;
+	tv.tv_usec= (timeout% 1000)* 1000;
+
+	res= select( fd+ 1, &rfds, NULL, NULL, timeout < 0 ? NULL : &tv);
+	if( res < 0 && errno == EINTR)
+		return 0;
+	return res;
+}
+
 /*---------------------------------------------------------------------------*/
 /**
   @brief	close serial port
@@ -281,6 +326,34 @@ int	SerialSetSpeed( int port, unsigned int speed)
 	return SERIAL_OK;
 }
 
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	let one read() return a whole burst of input
+  @param	port		port number
+  @param	min		bytes to wait for, at most 255
+  @param	gap		inter-character timeout in 0.1 s, ends a short burst
+  @return	return SERIAL_OK for success, on error return error code
+
+  A read returns once min bytes have arrived or the line has been idle for
+  gap after the first byte, instead of after every byte at low speeds.
+ */
+/*---------------------------------------------------------------------------*/
+int	SerialSetReadBurst( int port, int min, int gap)
+{
+	int fd= FindFD( port);
+
+	if( fd < 0)			///< error
+		return fd;
+	if( min < 1 || min > 255 || gap < 0 || gap > 255)
+		return SERIAL_PARAMETER_ERROR;
+
+	newtio[ port].c_cc[ VMIN]= min;
+	newtio[ port].c_cc[ VTIME]= gap;
+	tcsetattr( fd, TCSANOW, &newtio[ port]);
+
+	return SERIAL_OK;
+}
+
 /*---------------------------------------------------------------------------*/
 /**
   @brief	set serial port mode for RS232/RS422/RS485
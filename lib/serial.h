@@ -33,8 +33,20 @@
 #include <errno.h>
 #include <termios.h>
 #include <asm/ioctls.h>
-
+#include <sys/select.h>
+
+#ifdef NO_MOXADEVICE
+/* off target builds (native x86 tests): the MOXA UART driver's ioctls */
+#include <sys/ioctl.h>
+#define MOXA_SET_OP_MODE			(0x400+66)
+#define MOXA_GET_OP_MODE			(0x400+67)
+#define RS232_MODE				0
+#define RS485_2WIRE_MODE			1
+#define RS422_MODE				2
+#define RS485_4WIRE_MODE			3
+#else
 #include "moxadevice.h"
+#endif
 
 #define PORT1					0
 #define PORT2					1
@@ -61,14 +73,17 @@
 #define	CMSPAR					010000000000	///< mark or space (stick) parity
 
 int	SerialOpen( int port);
+int	SerialOpenDevice( int port, const char *device);
 int	SerialWrite( int port, char* str, int len);
 int	SerialNonBlockRead( int port, char* buf, int len);
 int	SerialBlockRead( int port, char* buf, int len);
+int	SerialWaitRead( int port, int timeout);
 int	SerialClose( int port);
 int	SerialDataInInputQueue( int port);
 int	SerialDataInOutputQueue( int port);
 int	SerialFlowControl( int port, int control);
 int	SerialSetSpeed( int port, unsigned int speed);
+int	SerialSetReadBurst( int port, int min, int gap);
 int	SerialSetMode( int port, unsigned int mode);
 int	SerialGetMode( int port);
 int	SerialSetParam( int port, int parity, int databits, int stopbit);
@@ -23,46 +23,177 @@
 
 #include "socket.h"
 
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/time.h>
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	convert a peer address to a numeric string
+  @param	sa		socket address
+  @param	salen		length of sa
+  @param	str		output buffer, at least TCP_ADDR_LEN bytes
+  @return	none
+
+  IPv4-mapped IPv6 peers of a dual-stack socket are shown in the dotted
+  IPv4 form, the same string the IPv4-only version used to return.
+ */
+/*---------------------------------------------------------------------------*/
+static void	SockAddrToString( const struct sockaddr *sa, socklen_t salen, char *str)
+{
+	if( getnameinfo( sa, salen, str, TCP_ADDR_LEN, NULL, 0, NI_NUMERICHOST) != 0)
+	{
+		str[ 0]= '\0';
+		return;
+	}
+
+	if( sa->sa_family == AF_INET6 && strncmp( str, "::ffff:", 7) == 0 && strchr( str+ 7, '.'))
+		memmove( str, str+ 7, strlen( str+ 7)+ 1);
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	resolve an address for the given socket family
+  @param	family		AF_UNSPEC, AF_INET or AF_INET6
+  @param	host		host name or literal, NULL for the wildcard address
+  @param	port		port number
+  @param	res		resolved address list, free with freeaddrinfo()
+  @return	return zero for success, on error -1 is returned
+ */
+/*---------------------------------------------------------------------------*/
+static int	SockResolve( int family, const char *host, int port, struct addrinfo **res)
+{
+	struct addrinfo hints;
+	char service[ 8];
+
+	bzero( &hints, sizeof(hints));
+	hints.ai_family = family;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = host ? AI_ADDRCONFIG : AI_PASSIVE;
+
+	snprintf( service, sizeof(service), "%d", port);
+
+	if( getaddrinfo( host, service, &hints, res) != 0)
+		return -1;
+
+	return 0;
+}
+
 /*---------------------------------------------------------------------------*/
 /**
   @brief	initialize TCP server
   @param	port		port number for socket
   @param	serverfd	server socket fd
   @return	return server socked fd for success, on error return error code
+
+  The socket is a dual-stack IPv6 socket accepting IPv4 clients as mapped
+  addresses; kernels without IPv6 get a plain IPv4 socket instead.
  */
 /*---------------------------------------------------------------------------*/
 int	TCPServerInit( int port, int *serverfd)
 {
-	struct sockaddr_in dest;
+	struct addrinfo *res, *ai;
+	int on= 1, off= 0;
 
-	/// create socket , same as client
-	*serverfd = socket(PF_INET, SOCK_STREAM, 0);
+	*serverfd = -1;
 
-	/// initialize structure dest
-	bzero((void*)&dest, sizeof(dest));
-	dest.sin_family = PF_INET;
-	dest.sin_port = htons( port);
+	/// prefer one IPv6 socket serving both families, fall back to IPv4
+	if( SockResolve( AF_INET6, NULL, port, &res) < 0 && SockResolve( AF_INET, NULL, port, &res) < 0)
+		return -1;
+
+	for( ai= res; ai != NULL; ai= ai->ai_next)
+	{
+		*serverfd = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if( *serverfd < 0)
+			continue;
 
-	dest.sin_addr.s_addr = INADDR_ANY;
+		setsockopt( *serverfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		if( ai->ai_family == AF_INET6)
+			setsockopt( *serverfd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
 
-	/// Assign a port number to socket
-	bind( *serverfd, (struct sockaddr*)&dest, sizeof(dest));
+		/// Assign a port number to socket
+		if( bind( *serverfd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+
+		close( *serverfd);
+		*serverfd = -1;
+	}
+	freeaddrinfo( res);
+
+	/// no IPv6 support in the kernel, retry with IPv4 only
+	if( *serverfd < 0 && SockResolve( AF_INET, NULL, port, &res) == 0)
+	{
+		*serverfd = socket( res->ai_family, res->ai_socktype, res->ai_protocol);
+		if( *serverfd >= 0)
+		{
+			setsockopt( *serverfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+			if( bind( *serverfd, res->ai_addr, res->ai_addrlen) != 0)
+			{
+				close( *serverfd);
+				*serverfd = -1;
+			}
+		}
+		freeaddrinfo( res);
+	}
 
 	return *serverfd;
 }
 
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	initialize one TCP server socket per address family
+  @param	port		port number for socket
+  @param	serverfdlist	server socket fd list
+  @param	max		size of serverfdlist
+  @return	return number of sockets for success, on error -1 is returned
+
+  For hosts where a single dual-stack socket is not possible (for example
+  net.ipv6.bindv6only=1); the list is meant for TCPServerSelect().
+ */
+/*---------------------------------------------------------------------------*/
+int	TCPServerInitList( int port, int *serverfdlist, int max)
+{
+	struct addrinfo *res, *ai;
+	int fd, num= 0, on= 1;
+
+	if( SockResolve( AF_UNSPEC, NULL, port, &res) < 0)
+		return -1;
+
+	for( ai= res; ai != NULL && num < max; ai= ai->ai_next)
+	{
+		fd = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if( fd < 0)
+			continue;
+
+		setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		if( ai->ai_family == AF_INET6)
+			setsockopt( fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+
+		if( bind( fd, ai->ai_addr, ai->ai_addrlen) != 0)
+		{
+			close( fd);
+			continue;
+		}
+		serverfdlist[ num++]= fd;
+	}
+	freeaddrinfo( res);
+
+	return num ? num : -1;
+}
+
 /*---------------------------------------------------------------------------*/
 /**
   @brief	wait client connect
   @param	serverfd	server socket fd
   @param	clientfd	client socket fd
-  @param	clientaddr	client address which connect to server
+  @param	clientaddr	client address which connect to server, TCP_ADDR_LEN bytes
   @return	return client fd, on error return error code
  */
 /*---------------------------------------------------------------------------*/
 int	TCPServerWaitConnection( int serverfd, int *clientfd, char *clientaddr)
 {
-	struct sockaddr_in client_addr;
+	struct sockaddr_storage client_addr;
 	socklen_t addrlen = sizeof(client_addr);
 
 	/// make it listen to socket
@@ -71,7 +202,10 @@ int	TCPServerWaitConnection( int serverfd, int *clientfd, char *clientaddr)
 	/// Wait and Accept connection
 	*clientfd = accept(serverfd, (struct sockaddr*)&client_addr, &addrlen);
 
-	strcpy( clientaddr, (const char *)( inet_ntoa( client_addr.sin_addr)));
+	if( *clientfd < 0)
+		clientaddr[ 0]= '\0';
+	else
+		SockAddrToString( (struct sockaddr*)&client_addr, addrlen, clientaddr);
 
 	return *clientfd;
 }
@@ -82,15 +216,15 @@ int	TCPServerWaitConnection( int serverfd, int *clientfd, char *clientaddr)
   @param	serverfdlist	server socket fd list
   @param	num		number of server fd
   @param	clientfd	client socket fd
-  @param	clientaddr	client address which connect to server
+  @param	clientaddr	client address which connect to server, TCP_ADDR_LEN bytes
   @return	return server fd, on error return error code
  */
 /*---------------------------------------------------------------------------*/
 int	TCPServerSelect( int* serverfdlist, int num, int *clientfd, char *clientaddr)
 {
-	struct sockaddr_in client_addr;
+	struct sockaddr_storage client_addr;
 	fd_set rfds;
-	int i, maxfd, readfds;
+	int i, maxfd;
 
 	socklen_t addrlen = sizeof(client_addr);
 
@@ -124,11 +258,14 @@ int	TCPServerSelect( int* serverfdlist, int num, int *clientfd, char *clientaddr
 	/// Wait and Accept connection
 	*clientfd = accept( serverfdlist[ i], (struct sockaddr*)&client_addr, &addrlen);
 
-	strcpy( clientaddr, (const char *)( inet_ntoa( client_addr.sin_addr)));
-
 	/// Bind port error
 	if( *clientfd < 0)
+	{
+		clientaddr[ 0]= '\0';
 		return -1;
+	}
+
+	SockAddrToString( (struct sockaddr*)&client_addr, addrlen, clientaddr);
 	
 	return serverfdlist[ i];
 }
@@ -154,20 +291,207 @@ int	TCPClientInit( int *clientfd)
   @param	addr		server address
   @param	port		server port number
   @return	return zero for success, on error -1 is returned
+
+  The address is resolved for the family clientfd was created with; use
+  TCPClientOpen() to let the resolver pick the family.
  */
 /*---------------------------------------------------------------------------*/
 int	TCPClientConnect( const int clientfd, const char *addr, int port)
 {
-	struct sockaddr_in dest;
+	struct sockaddr_storage local;
+	struct addrinfo *res;
+	socklen_t len= sizeof(local);
+	int ret;
+
+	/// an unbound socket still reports its family
+	bzero( &local, sizeof(local));
+	if( getsockname( clientfd, (struct sockaddr*)&local, &len) < 0)
+		local.ss_family = AF_INET;
 
-	/// initialize value in dest
-	bzero(&dest, sizeof(dest));
-	dest.sin_family = PF_INET;
-	dest.sin_port = htons( port);
-	inet_aton( addr, &dest.sin_addr);
+	if( SockResolve( local.ss_family, addr, port, &res) < 0)
+		return -1;
 
 	/// Connecting to server
-	return connect(clientfd, (struct sockaddr*)&dest, sizeof(dest));
+	ret = connect( clientfd, res->ai_addr, res->ai_addrlen);
+	freeaddrinfo( res);
+
+	return ret;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	milliseconds of CLOCK_MONOTONIC
+  @return	current time in ms
+ */
+/*---------------------------------------------------------------------------*/
+static long long	SockNow( void)
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec* 1000+ ts.tv_nsec/ 1000000;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	bound the blocking reads and writes of a socket
+  @param	clientfd	socket fd
+  @param	timeout		timeout in ms for each send() and recv()
+  @return	return zero for success, on error -1 is returned
+
+  A send() or recv() that makes no progress for timeout ms fails with
+  EAGAIN. Keepalive probes are enabled too, so a peer that disappears
+  from an idle connection is noticed.
+ */
+/*---------------------------------------------------------------------------*/
+int	TCPSetTimeout( int clientfd, int timeout)
+{
+	struct timeval tv;
+	int on= 1;
+
+	tv.tv_sec= timeout/ 1000;
+	tv.tv_usec= (timeout% 1000)* 1000;
+
+	if( setsockopt( clientfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0 ||
+	    setsockopt( clientfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0 ||
+	    setsockopt( clientfd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) < 0)
+		return -1;
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	resolve a server and connect to the fastest of its addresses
+  @param	clientfd	client socket fd, set on success
+  @param	host		server name or address literal, IPv4 or IPv6
+  @param	port		server port number
+  @param	timeout		overall connect timeout in ms
+  @return	return zero for success, on error -1 is returned
+
+  Resolved addresses are interleaved by family, IPv6 first, and a new
+  attempt is started every TCP_ATTEMPT_DELAY ms (or as soon as the previous
+  one fails) while earlier attempts stay pending. The first connection to
+  complete wins and the others are closed, so a broken or slow path of
+  one family never costs more than the attempt delay.
+
+  The connected socket is blocking, with the same timeout set for each of
+  its reads and writes (TCPSetTimeout()), so a stalled server can't block
+  the caller for good.
+ */
+/*---------------------------------------------------------------------------*/
+int	TCPClientOpen( int *clientfd, const char *host, int port, int timeout)
+{
+	struct addrinfo *res, *ai, *v6[ TCP_MAX_ATTEMPTS], *v4[ TCP_MAX_ATTEMPTS];
+	struct addrinfo *order[ TCP_MAX_ATTEMPTS];
+	struct pollfd pfd[ TCP_MAX_ATTEMPTS];
+	int n6= 0, n4= 0, num= 0, started= 0, pending= 0;
+	int i, err, opts, wait;
+	socklen_t len;
+	long long now, deadline, next;
+
+	*clientfd = -1;
+
+	if( SockResolve( AF_UNSPEC, host, port, &res) < 0)
+		return -1;
+
+	/// interleave families so a dead family can't starve the other
+	for( ai= res; ai != NULL; ai= ai->ai_next)
+	{
+		if( ai->ai_family == AF_INET6 && n6 < TCP_MAX_ATTEMPTS)
+			v6[ n6++]= ai;
+		else if( ai->ai_family == AF_INET && n4 < TCP_MAX_ATTEMPTS)
+			v4[ n4++]= ai;
+	}
+	for( i= 0; num < TCP_MAX_ATTEMPTS && (i < n6 || i < n4); i++)
+	{
+		if( i < n6)
+			order[ num++]= v6[ i];
+		if( i < n4 && num < TCP_MAX_ATTEMPTS)
+			order[ num++]= v4[ i];
+	}
+
+	now = SockNow();
+	deadline = now+ timeout;
+	next = now;
+
+	while( *clientfd < 0)
+	{
+		now = SockNow();
+		if( now >= deadline)
+			break;
+
+		/// start the next attempt when its turn comes or nothing is pending
+		if( started < num && (now >= next || pending == 0))
+		{
+			ai = order[ started++];
+			pfd[ pending].fd = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+			if( pfd[ pending].fd >= 0)
+			{
+				opts = fcntl( pfd[ pending].fd, F_GETFL);
+				fcntl( pfd[ pending].fd, F_SETFL, opts | O_NONBLOCK);
+				if( connect( pfd[ pending].fd, ai->ai_addr, ai->ai_addrlen) == 0 || errno == EINPROGRESS)
+				{
+					pfd[ pending].events = POLLOUT;
+					pending++;
+				}
+				else
+					close( pfd[ pending].fd);
+			}
+			next = now+ TCP_ATTEMPT_DELAY;
+			continue;
+		}
+
+		if( pending == 0)
+			break;
+
+		wait = (int)(deadline- now);
+		if( started < num && next- now < wait)
+			wait = (int)(next- now);
+
+		if( poll( pfd, pending, wait) <= 0)
+			continue;
+
+		for( i= 0; i< pending; i++)
+		{
+			if( pfd[ i].revents == 0)
+				continue;
+
+			err = 0;
+			len = sizeof(err);
+			getsockopt( pfd[ i].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+			if( err == 0)
+			{
+				*clientfd = pfd[ i].fd;
+				pfd[ i]= pfd[ --pending];
+				break;
+			}
+
+			/// this attempt failed, let the next one start right away
+			close( pfd[ i].fd);
+			pfd[ i--]= pfd[ --pending];
+			next = now;
+		}
+	}
+
+	for( i= 0; i< pending; i++)
+		close( pfd[ i].fd);
+	freeaddrinfo( res);
+
+	if( *clientfd < 0)
+		return -1;
+
+	opts = fcntl( *clientfd, F_GETFL);
+	fcntl( *clientfd, F_SETFL, opts & ~O_NONBLOCK);
+
+	if( TCPSetTimeout( *clientfd, timeout) < 0)
+	{
+		close( *clientfd);
+		*clientfd = -1;
+		return -1;
+	}
+
+	return 0;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -12,6 +12,10 @@
   TCP socket utility functions, it provides simple functions that helps
   to build TCP client/server.
 
+  Addresses are resolved with getaddrinfo(), so servers listen on both
+  IPv6 and IPv4 and clients can connect to names or literals of either
+  family. TCPClientOpen() races the resolved addresses Happy Eyeballs
+  style (RFC 8305) and keeps whichever connection completes first.
 
   History:
   Date		Author			Comment
@@ -25,20 +29,32 @@
 #define SOCKET_H
 
 #include <stdio.h>
+#include <string.h>
 #include <strings.h>
+#include <unistd.h>
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
 #include <resolv.h>
 #include <fcntl.h>
 
 #define MAX_CONNECTION				20
 
+#define TCP_ADDR_LEN				INET6_ADDRSTRLEN	///< size of the clientaddr buffers
+#define TCP_MAX_ATTEMPTS			8	///< resolved addresses raced by TCPClientOpen()
+#define TCP_ATTEMPT_DELAY			250	///< ms before the next address is tried (RFC 8305)
+
 int	TCPServerInit( int port, int *serverfd);
+int	TCPServerInitList( int port, int *serverfdlist, int max);
 int	TCPServerWaitConnection( int serverfd, int *clientfd, char *clientaddr);
 int     TCPServerSelect( int* serverfdlist, int num, int *clientfd, char *clientaddr);
 int	TCPClientInit( int *clientfd);
 int	TCPClientConnect( const int clientfd, const char *addr, int port);
+int	TCPClientOpen( int *clientfd, const char *host, int port, int timeout);
+int	TCPSetTimeout( int clientfd, int timeout);
 int	TCPNonBlockRead( int clientfd, char* buf, int size);
 int     TCPBlockRead( int clientfd, char* buf, int size);
 int	TCPWrite( int clientfd, char* buf, int size);
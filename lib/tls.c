@@ -0,0 +1,227 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		tls.c
+  @brief	TLS client API define file
+
+  TLS client functions layered on the TCP socket utility functions. A
+  TLSConn keeps the negotiated session after the connection is closed, so
+  the next TLSConnect() resumes it with an abbreviated handshake instead of
+  paying for a full one (certificate chain and key exchange) again.
+
+ */
+/*---------------------------------------------------------------------------*/
+
+#include "tls.h"
+
+static int	tls_index= -1;	///< ex_data slot pointing from SSL back to its TLSConn
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	keep new sessions for resumption
+  @param	ssl		connection that received the session
+  @param	session		new session, owned by us when 1 is returned
+  @return	1 if the session was kept, otherwise 0
+
+  TLS 1.3 delivers session tickets after the handshake, so the session is
+  captured here rather than with SSL_get1_session() after SSL_connect().
+ */
+/*---------------------------------------------------------------------------*/
+static int	TLSNewSession( SSL *ssl, SSL_SESSION *session)
+{
+	TLSConn *conn= SSL_get_ex_data( ssl, tls_index);
+
+	if( conn == NULL)
+		return 0;
+
+	if( conn->session)
+		SSL_SESSION_free( conn->session);
+	conn->session= session;
+
+	return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	initialize TLS client
+  @param	conn		connection to initialize
+  @param	cafile		PEM file with trusted certificates, NULL for the system store
+  @return	return TLS_OK for success, on error return error code
+ */
+/*---------------------------------------------------------------------------*/
+int	TLSInit( TLSConn *conn, const char *cafile)
+{
+	bzero( conn, sizeof(TLSConn));
+	conn->fd= -1;
+
+	if( tls_index < 0)
+	{
+		SSL_library_init();
+		SSL_load_error_strings();
+		tls_index= SSL_get_ex_new_index( 0, NULL, NULL, NULL, NULL);
+	}
+
+	conn->ctx= SSL_CTX_new( SSLv23_client_method());
+	if( conn->ctx == NULL)
+		return TLS_ERROR_CTX;
+
+	SSL_CTX_set_options( conn->ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION);
+	SSL_CTX_set_verify( conn->ctx, SSL_VERIFY_PEER, NULL);
+
+	if( cafile)
+	{
+		if( SSL_CTX_load_verify_locations( conn->ctx, cafile, NULL) != 1)
+		{
+			TLSFree( conn);
+			return TLS_ERROR_CTX;
+		}
+	}
+	else
+		SSL_CTX_set_default_verify_paths( conn->ctx);
+
+	/// client side cache only, the sessions themselves live in conn
+	SSL_CTX_set_session_cache_mode( conn->ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb( conn->ctx, TLSNewSession);
+
+	return TLS_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	connect to TLS server
+  @param	conn		initialized connection
+  @param	host		server name, also used for SNI and certificate check
+  @param	port		server port number
+  @param	timeout		TCP connect timeout in ms
+  @return	return TLS_OK for success, on error return error code
+ */
+/*---------------------------------------------------------------------------*/
+int	TLSConnect( TLSConn *conn, const char *host, int port, int timeout)
+{
+	TLSClose( conn);
+
+	if( TCPClientOpen( &conn->fd, host, port, timeout) < 0)
+		return TLS_ERROR_CONNECT;
+
+	conn->ssl= SSL_new( conn->ctx);
+	if( conn->ssl == NULL)
+	{
+		TLSClose( conn);
+		return TLS_ERROR_CTX;
+	}
+
+	SSL_set_ex_data( conn->ssl, tls_index, conn);
+	SSL_set_fd( conn->ssl, conn->fd);
+	SSL_set_tlsext_host_name( conn->ssl, host);
+	SSL_set1_host( conn->ssl, host);
+
+	/// offer the previous session, the server decides whether to resume
+	if( conn->session)
+		SSL_set_session( conn->ssl, conn->session);
+
+	if( SSL_connect( conn->ssl) != 1)
+	{
+		/// a rejected ticket must not be offered again
+		if( conn->session)
+		{
+			SSL_SESSION_free( conn->session);
+			conn->session= NULL;
+		}
+		TLSClose( conn);
+		return TLS_ERROR_HANDSHAKE;
+	}
+
+	conn->resumed= SSL_session_reused( conn->ssl);
+
+	return TLS_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	block read from TLS connection
+  @param	conn		connection
+  @param	buf		input buffer
+  @param	size		buffer size
+  @return	the length of read data, 0 on close, -1 on error
+ */
+/*---------------------------------------------------------------------------*/
+int	TLSBlockRead( TLSConn *conn, char *buf, int size)
+{
+	int len;
+
+	if( conn->ssl == NULL)
+		return -1;
+
+	len= SSL_read( conn->ssl, buf, size);
+	if( len <= 0)
+		return SSL_get_error( conn->ssl, len) == SSL_ERROR_ZERO_RETURN ? 0 : -1;
+
+	return len;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	write to TLS connection
+  @param	conn		connection
+  @param	buf		output buffer
+  @param	size		output string length
+  @return	the length of the actual written data, -1: disconnected
+ */
+/*---------------------------------------------------------------------------*/
+int	TLSWrite( TLSConn *conn, char *buf, int size)
+{
+	int len;
+
+	if( conn->ssl == NULL)
+		return -1;
+
+	len= SSL_write( conn->ssl, buf, size);
+
+	return len > 0 ? len : -1;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	close the TLS connection, keeping the session for resumption
+  @param	conn		connection
+  @return	none
+ */
+/*---------------------------------------------------------------------------*/
+void	TLSClose( TLSConn *conn)
+{
+	if( conn->ssl)
+	{
+		SSL_shutdown( conn->ssl);
+		SSL_free( conn->ssl);
+		conn->ssl= NULL;
+	}
+
+	if( conn->fd >= 0)
+	{
+		TCPClientClose( conn->fd);
+		conn->fd= -1;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  @brief	close the connection and release the context and session
+  @param	conn		connection
+  @return	none
+ */
+/*---------------------------------------------------------------------------*/
+void	TLSFree( TLSConn *conn)
+{
+	TLSClose( conn);
+
+	if( conn->session)
+	{
+		SSL_SESSION_free( conn->session);
+		conn->session= NULL;
+	}
+
+	if( conn->ctx)
+	{
+		SSL_CTX_free( conn->ctx);
+		conn->ctx= NULL;
+	}
+}
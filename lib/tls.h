@@ -0,0 +1,41 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		tls.h
+  @brief	TLS client API header file
+
+  TLS client functions layered on the TCP socket utility functions. A
+  TLSConn keeps the negotiated session after the connection is closed, so
+  the next TLSConnect() resumes it with an abbreviated handshake instead of
+  paying for a full one (certificate chain and key exchange) again.
+
+ */
+/*---------------------------------------------------------------------------*/
+
+#ifndef TLS_H
+#define TLS_H
+
+#include <openssl/ssl.h>
+
+#include "socket.h"
+
+#define	TLS_OK					0
+#define TLS_ERROR_CTX				-1	///< Could not set up the TLS context
+#define TLS_ERROR_CONNECT			-2	///< TCP connect failed
+#define TLS_ERROR_HANDSHAKE			-3	///< TLS handshake or certificate check failed
+
+typedef struct {
+	int		fd;		///< underlying TCP socket, -1 when closed
+	SSL_CTX		*ctx;
+	SSL		*ssl;
+	SSL_SESSION	*session;	///< last session ticket, reused on reconnect
+	int		resumed;	///< last handshake resumed the session
+} TLSConn;
+
+int	TLSInit( TLSConn *conn, const char *cafile);
+int	TLSConnect( TLSConn *conn, const char *host, int port, int timeout);
+int	TLSBlockRead( TLSConn *conn, char *buf, int size);
+int	TLSWrite( TLSConn *conn, char *buf, int size);
+void	TLSClose( TLSConn *conn);
+void	TLSFree( TLSConn *conn);
+
+#endif
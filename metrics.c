@@ -0,0 +1,153 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		metrics.c
+  @brief	hot path counters and latency histograms for getwind
+
+  Counters live in a POSIX shared memory page (/dev/shm/getwind.metrics) so
+  they can be read at any time, by "getwind -m" or any other process,
+  without stopping or attaching to getwind. getwind is the only writer and
+  every field is an aligned 32 bit word, so updates are plain stores and
+  readers never wait. Counters wrap at 2^32, readers should use deltas.
+ */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "metrics.h"
+
+static METRICS local;	/* used when the shared page can't be created */
+METRICS *metrics = &local;
+
+int metrics_init(void)
+{
+	METRICS *m;
+	int fd;
+
+	memset(&local, 0, sizeof(local));
+	local.magic = METRICS_MAGIC;
+	local.size = sizeof(METRICS);
+	local.pid = getpid();
+	local.started = time(NULL);
+
+	fd = shm_open(METRICS_NAME, O_RDWR | O_CREAT, 0644);
+	if(fd < 0)
+		return -1;
+	if(ftruncate(fd, sizeof(METRICS)) < 0) {
+		close(fd);
+		return -1;
+	}
+	m = mmap(NULL, sizeof(METRICS), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(m == MAP_FAILED)
+		return -1;
+
+	memcpy(m, &local, sizeof(METRICS));
+	metrics = m;
+	return 0;
+}
+
+void metrics_close(void)
+{
+	if(metrics != &local) {
+		munmap(metrics, sizeof(METRICS));
+		metrics = &local;
+	}
+}
+
+/* ns of CLOCK_MONOTONIC */
+uint64_t metrics_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* add the time since start to a histogram */
+void metrics_observe(HISTOGRAM *h, uint64_t start)
+{
+	uint64_t ns = metrics_clock() - start;
+	uint32_t us = ns / 1000;
+	int i = 0;
+
+	while(i < METRICS_BUCKETS-1 && (ns >> (i+1)) != 0)
+		i++;
+
+	h->bucket[i]++;
+	h->count++;
+	h->sum_us += us;
+	if(us > h->max_us)
+		h->max_us = us;
+}
+
+/* upper bound in us of the bucket holding the given quantile */
+static uint32_t histogram_quantile(HISTOGRAM *h, double q)
+{
+	uint32_t n = 0, us;
+	int i;
+
+	for(i=0; i<METRICS_BUCKETS; i++) {
+		n += h->bucket[i];
+		if(n > 0 && n >= q * h->count) {
+			us = (uint32_t)((2ULL << i) / 1000);
+			return us < h->max_us ? us : h->max_us;
+		}
+	}
+	return h->max_us;
+}
+
+static void histogram_print(FILE *fp, const char *name, HISTOGRAM *h)
+{
+	fprintf(fp, "%s.count=%u\n", name, h->count);
+	fprintf(fp, "%s.avg_us=%u\n", name, h->count ? (uint32_t)(h->sum_us / h->count) : 0);
+	fprintf(fp, "%s.p50_us=%u\n", name, histogram_quantile(h, 0.50));
+	fprintf(fp, "%s.p99_us=%u\n", name, histogram_quantile(h, 0.99));
+	fprintf(fp, "%s.max_us=%u\n", name, h->max_us);
+}
+
+/* print the page of a running getwind */
+int metrics_dump(FILE *fp)
+{
+	METRICS m;
+	int fd;
+
+	fd = shm_open(METRICS_NAME, O_RDONLY, 0);
+	if(fd < 0 || read(fd, &m, sizeof(m)) != sizeof(m)) {
+		if(fd >= 0)
+			close(fd);
+		return -1;
+	}
+	close(fd);
+	if(m.magic != METRICS_MAGIC || m.size != sizeof(METRICS))
+		return -1;
+
+	fprintf(fp, "pid=%u\n", m.pid);
+	fprintf(fp, "uptime=%ld\n", (long)(time(NULL) - m.started));
+	fprintf(fp, "last_record_age=%ld\n", m.updated ? (long)(time(NULL) - m.updated) : -1L);
+	fprintf(fp, "serial.reads=%u\n", m.serial_reads);
+	fprintf(fp, "serial.bytes=%u\n", m.serial_bytes);
+	fprintf(fp, "serial.records=%u\n", m.records);
+	fprintf(fp, "serial.framing_errors=%u\n", m.framing_errors);
+	fprintf(fp, "serial.checksum_errors=%u\n", m.checksum_errors);
+	fprintf(fp, "serial.reopens=%u\n", m.reopens);
+	fprintf(fp, "serial.qc_rejected=%u\n", m.qc_rejected);
+	histogram_print(fp, "decode", &m.decode);
+	fprintf(fp, "upload.batches=%u\n", m.upload_batches);
+	fprintf(fp, "upload.failures=%u\n", m.upload_failures);
+	fprintf(fp, "upload.deferred=%u\n", m.upload_deferred);
+	fprintf(fp, "upload.records=%u\n", m.upload_records);
+	fprintf(fp, "upload.raw_bytes=%u\n", m.upload_raw_bytes);
+	fprintf(fp, "upload.sent_bytes=%u\n", m.upload_sent_bytes);
+	histogram_print(fp, "upload.rtt", &m.upload_rtt);
+	fprintf(fp, "spool.depth=%u\n", m.spool_depth);
+	fprintf(fp, "spool.dropped=%u\n", m.spool_dropped);
+	fprintf(fp, "budget.level=%u\n", m.budget_level);
+	fprintf(fp, "budget.used_mb=%u\n", m.budget_used_mb);
+	fprintf(fp, "budget.projected_mb=%u\n", m.budget_projected_mb);
+	fprintf(fp, "budget.batch=%u\n", m.batch);
+	fprintf(fp, "budget.image_interval=%u\n", m.image_interval);
+	return 0;
+}
@@ -0,0 +1,85 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		metrics.h
+  @brief	hot path counters and latency histograms for getwind
+
+  Counters live in a POSIX shared memory page (/dev/shm/getwind.metrics) so
+  they can be read at any time, by "getwind -m" or any other process,
+  without stopping or attaching to getwind. getwind is the only writer and
+  every field is an aligned 32 bit word, so updates are plain stores and
+  readers never wait. Counters wrap at 2^32, readers should use deltas.
+  The one exception is the latency sum of a histogram, 64 bits so it
+  doesn't wrap after 71 minutes of latency. On a 32 bit CPU a reader can
+  see its halves from two updates, which only skews one avg_us reading.
+ */
+/*---------------------------------------------------------------------------*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#define METRICS_NAME "/getwind.metrics"
+#define METRICS_MAGIC 0x314d5747	/* "GWM1" */
+#define METRICS_BUCKETS 36	/* bucket i counts [2^i, 2^(i+1)) ns, up to ~69 s */
+
+typedef struct {
+	uint32_t count;
+	uint64_t sum_us;
+	uint32_t max_us;
+	uint32_t bucket[METRICS_BUCKETS];
+} HISTOGRAM;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t size;
+	uint32_t pid;
+	uint32_t started;	/* unix time */
+	uint32_t updated;	/* unix time of last record */
+
+	/* serial input */
+	uint32_t serial_reads;	/* read() calls */
+	uint32_t serial_bytes;
+	uint32_t records;
+	uint32_t framing_errors;
+	uint32_t checksum_errors;
+	uint32_t reopens;
+	uint32_t qc_rejected;	/* fields removed by quality control */
+	HISTOGRAM decode;	/* station_decode() of one framed record */
+
+	/* upload */
+	uint32_t upload_batches;
+	uint32_t upload_failures;
+	uint32_t upload_deferred;	/* batches held back by rate control */
+	uint32_t upload_records;
+	uint32_t upload_raw_bytes;
+	uint32_t upload_sent_bytes;
+	HISTOGRAM upload_rtt;	/* whole flush, connect included */
+
+	/* spool */
+	uint32_t spool_depth;	/* gauge */
+	uint32_t spool_dropped;
+
+	/* monthly budget */
+	uint32_t budget_level;	/* BUDGET_ in budget.h */
+	uint32_t budget_used_mb;
+	uint32_t budget_projected_mb;
+	uint32_t batch;		/* records per upload now */
+	uint32_t image_interval;	/* s between camera images, 0 = none */
+} METRICS;
+
+extern METRICS *metrics;
+
+/* single writer, relaxed stores are enough for readers of the page */
+#define METRIC_ADD(field, n) (metrics->field += (n))
+#define METRIC_SET(field, v) (metrics->field = (v))
+
+int metrics_init(void);
+void metrics_close(void);
+uint64_t metrics_clock(void);
+void metrics_observe(HISTOGRAM *h, uint64_t start);
+int metrics_dump(FILE *fp);
+
+#endif
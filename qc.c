@@ -0,0 +1,140 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		qc.c
+  @brief	streaming quality control of station observations
+
+  Limits are per field. A spike is a sample further from the median of the
+  window than the spike limit. Raw samples go into the window whether they
+  pass or not, so a real step change is accepted once it is the median.
+ */
+/*---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include "qc.h"
+
+typedef struct {
+	int flag;		/* OBS_ bit of the field */
+	float min, max;		/* physical range */
+	float spike;		/* largest distance from the median, 0 = off */
+	float rate;		/* largest change per second, 0 = off */
+	int stuck;		/* s with one value before it is stuck, 0 = off */
+	float stuckmin;		/* smaller values are never stuck (calm) */
+	int circular;		/* degrees, differences wrap at 360 */
+} QCLIMITS;
+
+static const QCLIMITS limits[QC_FIELDS] = {
+	/* speed, m/s */
+	{ OBS_SPEED, 0, 90, 15, 30, 1800, 0.1f, 0 },
+	/* direction, spikes and fast turns are normal in light wind */
+	{ OBS_DIRECTION, 0, 360, 0, 0, 3600, 0, 1 },
+	/* temperature, degrees C */
+	{ OBS_TEMPERATURE, -50, 60, 5, 0.2f, 14400, -1000, 0 },
+	/* 1 minute average speed */
+	{ OBS_AVGSPEED, 0, 90, 10, 5, 3600, 0.1f, 0 },
+	/* gust, peaks are spiky by nature */
+	{ OBS_GUST, 0, 110, 0, 0, 0, 0, 0 }
+};
+
+void qc_init(QC *qc)
+{
+	memset(qc, 0, sizeof(QC));
+}
+
+static float get_field(const OBSERVATION *obs, int i)
+{
+	switch(i) {
+	case QC_SPEED: return obs->speed;
+	case QC_DIRECTION: return obs->direction;
+	case QC_TEMPERATURE: return obs->temperature;
+	case QC_AVGSPEED: return obs->avgspeed;
+	default: return obs->gust;
+	}
+}
+
+static float distance(float a, float b, int circular)
+{
+	float d = a > b ? a - b : b - a;
+
+	if(circular && d > 180)
+		d = 360 - d;
+	return d;
+}
+
+/* median of the window, insertion sort of a QC_MEDIAN copy */
+static float median(const QCFIELD *f)
+{
+	float v[QC_MEDIAN], x;
+	int i, j;
+
+	for(i=0; i<f->count; i++) {
+		x = f->window[i];
+		for(j=i; j>0 && v[j-1] > x; j--)
+			v[j] = v[j-1];
+		v[j] = x;
+	}
+	return v[f->count / 2];
+}
+
+static unsigned int check_field(QCFIELD *f, const QCLIMITS *l, float x, uint64_t now, float speed)
+{
+	unsigned int bad = 0;
+	double dt;
+
+	if(x < l->min || x > l->max)
+		return QC_RANGE;	/* not put in the window either */
+
+	/* spike against the median of the samples before this one */
+	if(l->spike > 0 && f->count == QC_MEDIAN && distance(x, median(f), l->circular) > l->spike)
+		bad |= QC_SPIKE;
+	f->window[f->pos] = x;
+	f->pos = (f->pos + 1) % QC_MEDIAN;
+	if(f->count < QC_MEDIAN)
+		f->count++;
+
+	/* change since the last good value, at least a second apart so the
+	   station's resolution step always passes */
+	if(l->rate > 0 && f->valid && !bad) {
+		dt = (now - f->lasttime) / 1e9;
+		if(distance(x, f->last, l->circular) > l->rate * (dt > 1 ? dt : 1))
+			bad |= QC_RATE;
+	}
+
+	if(l->stuck > 0) {
+		if(x != f->stuckvalue || x < l->stuckmin || (l->circular && speed < QC_DIR_MIN_SPEED)) {
+			f->stuckvalue = x;
+			f->stucksince = now;
+		}
+		else if(now - f->stucksince >= (uint64_t)l->stuck * 1000000000) {
+			bad |= QC_STUCK;
+		}
+	}
+
+	if(!bad) {
+		f->last = x;
+		f->lasttime = now;
+		f->valid = 1;
+	}
+	return bad;
+}
+
+/* check the fields of obs, failed ones are removed from obs->flags. returns
+   the reasons, also stored in obs->qc */
+unsigned int qc_filter(QC *qc, OBSERVATION *obs)
+{
+	unsigned int bad, all = 0;
+	float speed = (obs->flags & OBS_SPEED) ? obs->speed : 0;
+	int i;
+
+	for(i=0; i<QC_FIELDS; i++) {
+		if(!(obs->flags & limits[i].flag))
+			continue;
+		bad = check_field(&qc->field[i], &limits[i], get_field(obs, i), obs->monotonic, speed);
+		if(bad) {
+			obs->flags &= ~limits[i].flag;
+			qc->rejected[i]++;
+			all |= bad << QC_SHIFT(i);
+		}
+	}
+	obs->qc = all;
+	return all;
+}
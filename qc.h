@@ -0,0 +1,59 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		qc.h
+  @brief	streaming quality control of station observations
+
+  Every decoded sample passes qc_filter() before it is aggregated. Each
+  field is checked against its physical range, the median of its last
+  QC_MEDIAN samples (spikes), the largest plausible change per second and
+  how long it has kept the same value (stuck sensor). A field that fails is
+  removed from the observation and the reason is set in OBSERVATION.qc,
+  four bits per field, so the server can tell filtered from missing data.
+  All checks are constant time per sample.
+ */
+/*---------------------------------------------------------------------------*/
+
+#ifndef QC_H
+#define QC_H
+
+#include "station.h"
+
+#define QC_MEDIAN 5		/* samples in the spike median window, odd */
+#define QC_DIR_MIN_SPEED 2.0f	/* m/s, a still vane only counts as stuck in wind */
+
+/* reasons, shifted by QC_SHIFT(field) in OBSERVATION.qc */
+#define QC_RANGE 0x1
+#define QC_SPIKE 0x2
+#define QC_RATE 0x4
+#define QC_STUCK 0x8
+
+/* fields in OBSERVATION.qc order */
+#define QC_SPEED 0
+#define QC_DIRECTION 1
+#define QC_TEMPERATURE 2
+#define QC_AVGSPEED 3
+#define QC_GUST 4
+#define QC_FIELDS 5
+
+#define QC_SHIFT(field) ((field) * 4)
+
+typedef struct {
+	float window[QC_MEDIAN];	/* last raw samples */
+	int count;		/* samples in window */
+	int pos;		/* next slot */
+	int valid;		/* last is set */
+	float last;		/* last accepted value */
+	uint64_t lasttime;	/* monotonic ns of last */
+	float stuckvalue;
+	uint64_t stucksince;	/* monotonic ns stuckvalue was first seen */
+} QCFIELD;
+
+typedef struct {
+	QCFIELD field[QC_FIELDS];
+	unsigned long rejected[QC_FIELDS];
+} QC;
+
+void qc_init(QC *qc);
+unsigned int qc_filter(QC *qc, OBSERVATION *obs);
+
+#endif
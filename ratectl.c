@@ -0,0 +1,129 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		ratectl.c
+  @brief	set up and use the shared uplink rate control
+
+  ratectl link <bytes/s> <burst> <reserve>
+	create the segment if needed and set the link bucket
+  ratectl client <name> high|bulk <bytes/s> <burst>
+	add or change a client, a rate of 0 leaves it to the link bucket
+  ratectl wait <name> <bytes> [timeout ms]
+	return once <bytes> may be sent, exit status 1 on timeout
+  ratectl pipe <name>
+	copy stdin to stdout at the client's rate, e.g. for an image upload:
+	ratectl pipe camera < image.jpg | curl -T - ...
+  ratectl show
+	print the buckets
+
+  Clients that aren't set up (or no segment at all) are not limited.
+ */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ratelimit.h"
+
+#define PIPE_CHUNK 4096		/* bytes per token request, the preemption grain */
+
+static void usage(void)
+{
+	printf("Usage: ratectl link <bytes/s> <burst> <reserve>\n"
+	       "       ratectl client <name> high|bulk <bytes/s> <burst>\n"
+	       "       ratectl wait <name> <bytes> [timeout ms]\n"
+	       "       ratectl pipe <name>\n"
+	       "       ratectl show\n");
+}
+
+static int show(RATELIMIT *rl)
+{
+	int i;
+
+	printf("link rate=%lld burst=%lld tokens=%lld reserve=%lld\n",
+	       (long long)rl->link.rate, (long long)rl->link.burst,
+	       (long long)rl->link.tokens, (long long)rl->reserve);
+	for(i=0; i<RATE_MAX_CLIENTS; i++) {
+		if(rl->client[i].name[0] == '\0')
+			continue;
+		printf("%s %s rate=%lld burst=%lld tokens=%lld sent=%llu waits=%llu\n",
+		       rl->client[i].name, rl->client[i].priority == RATE_PRIO_HIGH ? "high" : "bulk",
+		       (long long)rl->client[i].bucket.rate, (long long)rl->client[i].bucket.burst,
+		       (long long)rl->client[i].bucket.tokens, (unsigned long long)rl->client[i].sent,
+		       (unsigned long long)rl->client[i].waits);
+	}
+	return 0;
+}
+
+/* copy stdin to stdout, taking tokens for every chunk */
+static int pipe_through(RATELIMIT *rl, int client)
+{
+	char buf[PIPE_CHUNK];
+	ssize_t len, done, ret;
+
+	while((len = read(0, buf, sizeof(buf))) > 0) {
+		if(rl && client >= 0)
+			RateWait(rl, client, len, -1);
+		for(done=0; done<len; done+=ret) {
+			ret = write(1, buf+done, len-done);
+			if(ret <= 0)
+				return 1;
+		}
+	}
+	return len < 0;
+}
+
+int main(int argc, char *argv[])
+{
+	RATELIMIT *rl;
+	int client, ret = 0;
+
+	if(argc < 2) {
+		usage();
+		return 1;
+	}
+
+	rl = RateOpen(strcmp(argv[1], "link") == 0 || strcmp(argv[1], "client") == 0);
+
+	if(strcmp(argv[1], "link") == 0 && argc == 5) {
+		if(rl == NULL) {
+			printf("Error: unable to create %s\n", RATE_NAME);
+			return 1;
+		}
+		RateSetLink(rl, atoll(argv[2]), atoll(argv[3]), atoll(argv[4]));
+	}
+	else if(strcmp(argv[1], "client") == 0 && argc == 6) {
+		if(rl == NULL) {
+			printf("Error: unable to create %s\n", RATE_NAME);
+			return 1;
+		}
+		if(RateSetClient(rl, argv[2], strcmp(argv[3], "high") == 0 ? RATE_PRIO_HIGH : RATE_PRIO_BULK,
+				 atoll(argv[4]), atoll(argv[5])) < 0) {
+			printf("Error: no free client slot\n");
+			ret = 1;
+		}
+	}
+	else if(strcmp(argv[1], "wait") == 0 && (argc == 4 || argc == 5)) {
+		client = rl ? RateFindClient(rl, argv[2]) : -1;
+		if(client >= 0)
+			ret = RateWait(rl, client, atoll(argv[3]), argc == 5 ? atoi(argv[4]) : -1) != RATE_OK;
+	}
+	else if(strcmp(argv[1], "pipe") == 0 && argc == 3) {
+		client = rl ? RateFindClient(rl, argv[2]) : -1;
+		ret = pipe_through(rl, client);
+	}
+	else if(strcmp(argv[1], "show") == 0) {
+		if(rl == NULL) {
+			printf("No rate control, %s doesn't exist\n", RATE_NAME);
+			return 1;
+		}
+		ret = show(rl);
+	}
+	else {
+		usage();
+		ret = 1;
+	}
+
+	RateClose(rl);
+	return ret;
+}
@@ -1,3 +1,34 @@
 #!/bin/sh
-/usr/bin/killall -9 getwind
+# getwind recovers from serial and uplink failures by itself, so it is
+# only started here if it isn't running (kill -TERM to stop it cleanly,
+# kill -USR1 to print its status).
+#
+# getwind writes its status file at startup and then every StatusInterval
+# seconds from the main loop. A file that missed three updates means the
+# loop is stuck: getwind is asked to exit with SIGTERM, which saves the
+# spool, and only killed if it hasn't gone after a minute.
+CONF=/etc/getwind.conf
+
+setting()
+{
+	sed -n "s/^[[:space:]]*$1[[:space:]]\{1,\}\"\{0,1\}\([^\"]*\)\"\{0,1\}[[:space:]]*$/\1/p" $CONF 2>/dev/null | tail -1
+}
+
+STATUS=$(setting StatusFile)
+INTERVAL=$(setting StatusInterval)
+STATUS=${STATUS:-/var/run/getwind.status}
+INTERVAL=${INTERVAL:-60}
+
+if pid=$(pidof getwind); then
+	age=$(( $(date +%s) - $(stat -c %Y $STATUS 2>/dev/null || echo 0) ))
+	[ $age -le $(( INTERVAL * 3 + 60 )) ] && exit 0
+
+	kill -TERM $pid
+	i=0
+	while [ $i -lt 60 ] && kill -0 $pid 2>/dev/null; do
+		sleep 1
+		i=$((i + 1))
+	done
+	kill -0 $pid 2>/dev/null && kill -9 $pid
+fi
 /home/wind/getwind
@@ -0,0 +1,133 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		spool.c
+  @brief	backlog of observation lines waiting for upload
+
+  A ring buffer of newline terminated lines. When it is full the oldest
+  lines are dropped, so an uplink outage costs the oldest data rather than
+  the newest. The ring is saved on shutdown and loaded on startup, so a
+  restart does not lose queued samples.
+ */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spool.h"
+
+int spool_init(SPOOL *sp, int size)
+{
+	memset(sp, 0, sizeof(SPOOL));
+	sp->buf = malloc(size);
+	if(sp->buf == NULL)
+		return -1;
+	sp->size = size;
+	return 0;
+}
+
+/* drop the oldest line */
+static void spool_drop(SPOOL *sp)
+{
+	while(sp->used > 0) {
+		sp->used--;
+		if(sp->buf[sp->head] == '\n') {
+			sp->head = (sp->head + 1) % sp->size;
+			break;
+		}
+		sp->head = (sp->head + 1) % sp->size;
+	}
+	sp->count--;
+	sp->dropped++;
+}
+
+/* append a line, a newline is added */
+int spool_push(SPOOL *sp, const char *line, int len)
+{
+	int tail, n;
+
+	if(len + 1 > sp->size)
+		return -1;
+
+	while(sp->size - sp->used < len + 1)
+		spool_drop(sp);
+
+	tail = (sp->head + sp->used) % sp->size;
+	n = sp->size - tail < len ? sp->size - tail : len;
+	memcpy(sp->buf + tail, line, n);
+	memcpy(sp->buf, line + n, len - n);
+	sp->buf[(tail + len) % sp->size] = '\n';
+	sp->used += len + 1;
+	sp->count++;
+	return 0;
+}
+
+/* copy whole lines from the oldest end, at most max bytes.
+   returns bytes copied, the lines stay queued until spool_pop().
+   spool_push() may drop them meanwhile, so peek again after a push */
+int spool_peek(SPOOL *sp, char *out, int max, int *lines)
+{
+	int i, len = 0, pos;
+
+	*lines = 0;
+	for(i=0; i<sp->used && i<max; i++) {
+		pos = (sp->head + i) % sp->size;
+		out[i] = sp->buf[pos];
+		if(out[i] == '\n') {
+			len = i + 1;
+			(*lines)++;
+		}
+	}
+	return len;
+}
+
+void spool_pop(SPOOL *sp, int len, int lines)
+{
+	sp->head = (sp->head + len) % sp->size;
+	sp->used -= len;
+	sp->count -= lines;
+}
+
+int spool_save(SPOOL *sp, const char *file)
+{
+	FILE *fp;
+	int n;
+
+	if((fp = fopen(file, "w")) == NULL)
+		return -1;
+
+	n = sp->size - sp->head < sp->used ? sp->size - sp->head : sp->used;
+	if(fwrite(sp->buf + sp->head, 1, n, fp) != (size_t)n ||
+	   fwrite(sp->buf, 1, sp->used - n, fp) != (size_t)(sp->used - n)) {
+		fclose(fp);
+		return -1;
+	}
+	return fclose(fp);
+}
+
+/* queue the lines of a saved spool file and remove it */
+int spool_load(SPOOL *sp, const char *file)
+{
+	FILE *fp;
+	char line[256];
+	int len, count = 0;
+
+	if((fp = fopen(file, "r")) == NULL)
+		return 0;
+
+	while(fgets(line, sizeof(line), fp) != NULL) {
+		len = strlen(line);
+		if(len > 0 && line[len-1] == '\n')
+			len--;
+		if(len > 0 && spool_push(sp, line, len) == 0)
+			count++;
+	}
+	fclose(fp);
+	remove(file);
+	return count;
+}
+
+void spool_free(SPOOL *sp)
+{
+	free(sp->buf);
+	sp->buf = NULL;
+}
@@ -0,0 +1,33 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		spool.h
+  @brief	backlog of observation lines waiting for upload
+
+  A ring buffer of newline terminated lines. When it is full the oldest
+  lines are dropped, so an uplink outage costs the oldest data rather than
+  the newest. The ring is saved on shutdown and loaded on startup, so a
+  restart does not lose queued samples.
+ */
+/*---------------------------------------------------------------------------*/
+
+#ifndef SPOOL_H
+#define SPOOL_H
+
+typedef struct {
+	char *buf;
+	int size;
+	int head;		/* oldest byte */
+	int used;		/* bytes in ring */
+	int count;		/* lines in ring */
+	unsigned long dropped;	/* lines dropped because the ring was full */
+} SPOOL;
+
+int spool_init(SPOOL *sp, int size);
+int spool_push(SPOOL *sp, const char *line, int len);
+int spool_peek(SPOOL *sp, char *out, int max, int *lines);
+void spool_pop(SPOOL *sp, int len, int lines);
+int spool_save(SPOOL *sp, const char *file);
+int spool_load(SPOOL *sp, const char *file);
+void spool_free(SPOOL *sp);
+
+#endif
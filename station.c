@@ -0,0 +1,396 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		station.c
+  @brief	weather station protocol drivers
+
+  Framing is shared: find a driver header in the buffered input, then the
+  CR/LF within the driver's record length. With no driver configured
+  ("auto") every header is tried and the first record that passes a
+  driver's check selects that driver for good.
+ */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "station.h"
+
+/* hex digit value + 1, 0 for anything else */
+static const unsigned char hexval[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16
+};
+
+/* four hex digits, -1 if any isn't one */
+static inline int hex4(const unsigned char *p)
+{
+	unsigned int a = hexval[p[0]], b = hexval[p[1]], c = hexval[p[2]], d = hexval[p[3]];
+
+	if(!a || !b || !c || !d)
+		return -1;
+	return (a-1) << 12 | (b-1) << 8 | (c-1) << 4 | (d-1);
+}
+
+/* Ultimeter scaling, speed in 0.1 km/h, direction 0-255, temperature in
+   signed 0.1 F */
+static inline float ult_speed(int v)
+{
+	return v / 36.0f;
+}
+
+static inline int ult_direction(int v)
+{
+	return (v & 0xff) * 360 / 255 % 360;	/* highest byte may be FF sometimes */
+}
+
+static inline float ult_temperature(int v)
+{
+	return ((int16_t)v / 10.0f - 32) * 5 / 9;
+}
+
+/* all of the record after the header is hex, "----" fields (no data) are
+   allowed in packet mode */
+static int ult_check(const unsigned char *p, int len, int dashes)
+{
+	int i;
+
+	for(i=0; i+4<=len; i+=4) {
+		if(hex4(p+i) < 0 && !(dashes && memcmp(p+i, "----", 4) == 0))
+			return STATION_ERROR_FORMAT;
+	}
+	return i == len ? STATION_OK : STATION_ERROR_FORMAT;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Ultimeter data logger mode, "!!" + 12 fields: wind speed, direction,
+   outdoor temperature, ..., 1 minute average wind speed */
+
+static int ultimeter_check(const unsigned char *line, int len)
+{
+	return ult_check(line+2, len-2, 0);
+}
+
+static int ultimeter_decode(const unsigned char *line, int len, OBSERVATION *obs)
+{
+	const unsigned char *p = line + 2;
+
+	obs->flags = OBS_SPEED | OBS_DIRECTION | OBS_TEMPERATURE | OBS_AVGSPEED;
+	obs->speed = ult_speed(hex4(p+0));
+	obs->direction = ult_direction(hex4(p+4));
+	obs->temperature = ult_temperature(hex4(p+8));
+	obs->avgspeed = ult_speed(hex4(p+44));
+	return STATION_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Ultimeter packet mode, "$ULTW" + 13 fields: peak wind speed of the last
+   5 minutes, direction of the peak, outdoor temperature, ..., 1 minute
+   average wind speed. Fields the station has no sensor for are "----".
+   There is no current speed, the peak goes out as gust, so this mode is
+   only for stations that can't be switched to data logger mode */
+
+static int ultimeter_packet_check(const unsigned char *line, int len)
+{
+	return ult_check(line+5, len-5, 1);
+}
+
+static int ultimeter_packet_decode(const unsigned char *line, int len, OBSERVATION *obs)
+{
+	const unsigned char *p = line + 5;
+	int v;
+
+	obs->flags = 0;
+	if((v = hex4(p+0)) >= 0) {
+		obs->gust = ult_speed(v);
+		obs->flags |= OBS_GUST;
+	}
+	if((v = hex4(p+4)) >= 0) {
+		obs->direction = ult_direction(v);
+		obs->flags |= OBS_DIRECTION;
+	}
+	if((v = hex4(p+8)) >= 0) {
+		obs->temperature = ult_temperature(v);
+		obs->flags |= OBS_TEMPERATURE;
+	}
+	if((v = hex4(p+48)) >= 0) {
+		obs->avgspeed = ult_speed(v);
+		obs->flags |= OBS_AVGSPEED;
+	}
+	return obs->flags ? STATION_OK : STATION_ERROR_FORMAT;
+}
+
+/*---------------------------------------------------------------------------*/
+/* NMEA 0183 "$--MWV,angle,R|T,speed,K|M|N|S,A|V*hh", any talker */
+
+static int mwv_check(const unsigned char *line, int len)
+{
+	unsigned char sum = 0;
+	int i, cs;
+
+	if(line[len-3] != '*')
+		return STATION_ERROR_FORMAT;
+	for(i=1; i<len-3; i++)
+		sum ^= line[i];
+	cs = hexval[line[len-2]] && hexval[line[len-1]] ?
+		(hexval[line[len-2]]-1) << 4 | (hexval[line[len-1]]-1) : -1;
+	if(cs < 0)
+		return STATION_ERROR_FORMAT;
+	return cs == sum ? STATION_OK : STATION_ERROR_CHECKSUM;
+}
+
+static int mwv_decode(const unsigned char *line, int len, OBSERVATION *obs)
+{
+	char buf[STATION_MAX_LINE], *field[6], *p, *end;
+	double angle, speed;
+	int n;
+
+	/* split the fields between "$--MWV," and "*hh" */
+	memcpy(buf, line+7, len-10);
+	buf[len-10] = '\0';
+	for(n=0, p=buf; n<6 && p; n++) {
+		field[n] = p;
+		if((p = strchr(p, ',')) != NULL)
+			*p++ = '\0';
+	}
+	if(n != 5 || field[4][0] != 'A' || line[6] != ',')
+		return STATION_ERROR_FORMAT;
+
+	angle = strtod(field[0], &end);
+	if(end == field[0] || angle < 0 || angle > 360)
+		return STATION_ERROR_FORMAT;
+	speed = strtod(field[2], &end);
+	if(end == field[2] || speed < 0)
+		return STATION_ERROR_FORMAT;
+
+	switch(field[3][0]) {
+	case 'K': speed /= 3.6; break;
+	case 'M': break;
+	case 'N': speed *= 1852.0 / 3600.0; break;
+	case 'S': speed *= 0.44704; break;
+	default: return STATION_ERROR_FORMAT;
+	}
+
+	obs->flags = OBS_SPEED | OBS_DIRECTION;
+	obs->speed = speed;
+	obs->direction = (int)(angle + 0.5) % 360;
+	return STATION_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static const STATION stations[] = {
+	{ "ultimeter", "!!", 2, 50, 50, ">I\r", ultimeter_check, ultimeter_decode },
+	{ "ultimeter-packet", "$ULTW", 5, 57, 57, ">K\r", ultimeter_packet_check, ultimeter_packet_decode },
+	{ "mwv", "$??MWV", 6, 17, 82, NULL, mwv_check, mwv_decode },
+	{ NULL, NULL, 0, 0, 0, NULL, NULL, NULL }
+};
+
+/* driver by name, NULL for "auto" or an unknown name */
+const STATION *station_find(const char *name)
+{
+	int i;
+
+	for(i=0; stations[i].name; i++) {
+		if(strcmp(stations[i].name, name) == 0)
+			return &stations[i];
+	}
+	return NULL;
+}
+
+void station_framer_init(FRAMER *fr, const STATION *drv)
+{
+	memset(fr, 0, sizeof(FRAMER));
+	fr->drv = drv;
+}
+
+/* does p (n bytes, may be less than the header) start drv's header */
+static inline int header_match(const STATION *drv, const unsigned char *p, int n)
+{
+	int i;
+
+	if(n > drv->headerlen)
+		n = drv->headerlen;
+	for(i=0; i<n; i++) {
+		if(drv->header[i] != '?' && drv->header[i] != p[i])
+			return 0;
+	}
+	return 1;
+}
+
+static const STATION *frame_match(FRAMER *fr, const unsigned char *p, int n)
+{
+	int i;
+
+	if(fr->drv)
+		return header_match(fr->drv, p, n) ? fr->drv : NULL;
+
+	for(i=0; stations[i].name; i++) {
+		if(header_match(&stations[i], p, n))
+			return &stations[i];
+	}
+	return NULL;
+}
+
+/* take the next record out of fr->buf into line, without CR LF. returns 1
+   for a record, 0 when more input is needed and STATION_ERROR_FORMAT when
+   a header wasn't followed by a record of the right length. The caller
+   appends input at fr->buf + fr->len */
+int station_frame(FRAMER *fr, unsigned char *line, int *len)
+{
+	const STATION *drv = NULL;
+	int i, end, limit;
+
+	/* find a header, a partial one at the end of the buffer is kept */
+	for(i=0; i<fr->len; i++) {
+		if((drv = frame_match(fr, fr->buf+i, fr->len-i)) != NULL)
+			break;
+	}
+	if(i > 0) {
+		memmove(fr->buf, fr->buf+i, fr->len-i);
+		fr->len -= i;
+	}
+	if(drv == NULL || fr->len < drv->headerlen)
+		return 0;
+
+	/* terminator within the longest record */
+	limit = fr->len < drv->maxlen+1 ? fr->len : drv->maxlen+1;
+	for(end=drv->headerlen; end<limit; end++) {
+		if(fr->buf[end] == '\r' || fr->buf[end] == '\n')
+			break;
+	}
+	if(end == limit && fr->len <= drv->maxlen)
+		return 0;
+
+	if(end == limit || end < drv->minlen) {
+		/* rescan after the header start, a truncated record may hide the next one */
+		memmove(fr->buf, fr->buf+1, fr->len-1);
+		fr->len--;
+		return STATION_ERROR_FORMAT;
+	}
+
+	memcpy(line, fr->buf, end);
+	*len = end;
+	fr->match = drv;
+
+	if(end+1 < fr->len && fr->buf[end] == '\r' && fr->buf[end+1] == '\n')
+		end++;
+	end++;
+	memmove(fr->buf, fr->buf+end, fr->len-end);
+	fr->len -= end;
+	return 1;
+}
+
+/* check and decode a framed record. in auto mode the first good record
+   fixes the driver */
+int station_decode(FRAMER *fr, const unsigned char *line, int len, OBSERVATION *obs)
+{
+	const STATION *drv = fr->drv ? fr->drv : fr->match;
+	int ret;
+
+	if(drv->check && (ret = drv->check(line, len)) < 0)
+		return ret;
+	if((ret = drv->decode(line, len, obs)) < 0)
+		return ret;
+
+	if(fr->drv == NULL) {
+		fr->drv = drv;
+		printf("Detected %s station\n", drv->name);
+	}
+	return STATION_OK;
+}
+
+/* observation as an upload line, only the fields the station sent */
+int station_format(const OBSERVATION *obs, char *out, int max)
+{
+	int len = 0;
+
+	out[0] = '\0';
+	if(obs->flags & OBS_SPEED)
+		len += snprintf(out+len, max-len, "speed=%.1f", obs->speed);
+	if(len < max && (obs->flags & OBS_DIRECTION))
+		len += snprintf(out+len, max-len, "%sdir=%d", len ? "&" : "", obs->direction);
+	if(len < max && (obs->flags & OBS_TEMPERATURE))
+		len += snprintf(out+len, max-len, "%stemp=%.1f", len ? "&" : "", obs->temperature);
+	if(len < max && (obs->flags & OBS_AVGSPEED))
+		len += snprintf(out+len, max-len, "%savgspeed=%.1f", len ? "&" : "", obs->avgspeed);
+	if(len < max && (obs->flags & OBS_GUST))
+		len += snprintf(out+len, max-len, "%sgust=%.1f", len ? "&" : "", obs->gust);
+	if(len < max && obs->qc)
+		len += snprintf(out+len, max-len, "%sqc=%x", len ? "&" : "", obs->qc);
+	if(len < max && obs->realtime)
+		len += snprintf(out+len, max-len, "%st=%llu.%03u&m=%llu.%03u", len ? "&" : "",
+				(unsigned long long)(obs->realtime / 1000000000), (unsigned int)(obs->realtime / 1000000 % 1000),
+				(unsigned long long)(obs->monotonic / 1000000000), (unsigned int)(obs->monotonic / 1000000 % 1000));
+	return len < max ? len : max-1;
+}
+
+void station_aggregate_add(AGGREGATE *a, const OBSERVATION *obs, long now)
+{
+	double rad;
+
+	if(a->count++ == 0) {
+		memset(a, 0, sizeof(AGGREGATE));
+		a->count = 1;
+		a->start = now;
+	}
+
+	if(obs->flags & OBS_SPEED) {
+		a->speedsum += obs->speed;
+		a->speedcount++;
+		if(obs->speed > a->gust)
+			a->gust = obs->speed;
+	}
+	if((obs->flags & OBS_GUST) && obs->gust > a->gust)
+		a->gust = obs->gust;
+	if(obs->flags & OBS_DIRECTION) {
+		rad = obs->direction * (M_PI / 180.0);
+		a->dirx += sin(rad);
+		a->diry += cos(rad);
+		a->dircount++;
+		a->direction = obs->direction;
+	}
+	if(obs->flags & OBS_TEMPERATURE)
+		a->temperature = obs->temperature;
+	if(obs->flags & OBS_AVGSPEED)
+		a->avgspeed = obs->avgspeed;
+	a->flags |= obs->flags;
+	a->qc |= obs->qc;
+	a->last = *obs;
+}
+
+/* the interval as one observation: mean speed, highest sample as gust, mean
+   direction from the unit vectors, latest valid temperature and average,
+   and the time stamp of the last sample, so the observation is dated by
+   the end of its interval. A field missing from or removed by quality
+   control in the last sample keeps its last valid value of the interval.
+   Returns the number of samples and starts a new interval */
+int station_aggregate_take(AGGREGATE *a, OBSERVATION *obs)
+{
+	int count = a->count, dir;
+
+	*obs = a->last;
+	obs->flags = a->flags;
+	obs->qc = a->qc;
+	if(a->speedcount > 0)
+		obs->speed = a->speedsum / a->speedcount;
+	if(a->flags & (OBS_SPEED | OBS_GUST)) {
+		obs->gust = a->gust;
+		obs->flags |= OBS_GUST;
+	}
+	if(a->dircount > 1) {
+		dir = (int)(atan2(a->dirx, a->diry) * (180.0 / M_PI) + 0.5);
+		obs->direction = (dir + 360) % 360;
+	}
+	else {
+		obs->direction = a->direction;
+	}
+	obs->temperature = a->temperature;
+	obs->avgspeed = a->avgspeed;
+
+	a->count = 0;
+	return count;
+}
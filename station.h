@@ -0,0 +1,92 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		station.h
+  @brief	weather station protocol drivers
+
+  A driver describes how a station's records are framed (header, length,
+  CR LF terminator), how they are checked and how they decode into an
+  OBSERVATION. The framer is shared by all drivers and works on the
+  buffered serial input, so only the header match, check and decode differ
+  between stations. Each driver is a const table entry with its own decode
+  function, field offsets and scaling are constants the compiler folds in.
+
+  Drivers:
+  ultimeter		Ultimeter data logger mode, "!!" + 48 hex
+  ultimeter-packet	Ultimeter packet mode, "$ULTW" + 52 hex, peak and
+			1 minute average only
+  mwv			NMEA 0183 wind sentence, "$--MWV,...*hh"
+ */
+/*---------------------------------------------------------------------------*/
+
+#ifndef STATION_H
+#define STATION_H
+
+#include <stdint.h>
+
+#define STATION_MAX_LINE 128	/* longest record a driver may accept */
+
+#define STATION_OK 0
+#define STATION_ERROR_FORMAT -1	/* bad length, field or status */
+#define STATION_ERROR_CHECKSUM -2
+
+/* OBSERVATION.flags, fields present in the record */
+#define OBS_SPEED 0x01
+#define OBS_DIRECTION 0x02
+#define OBS_TEMPERATURE 0x04
+#define OBS_AVGSPEED 0x08
+#define OBS_GUST 0x10
+
+typedef struct observation {
+	int flags;
+	float speed;		/* m/s */
+	int direction;		/* degrees */
+	float temperature;	/* degrees C */
+	float avgspeed;		/* m/s */
+	float gust;		/* m/s, highest speed sample */
+	uint64_t realtime;	/* CLOCK_REALTIME ns when the record ended, 0 = unknown */
+	uint64_t monotonic;	/* CLOCK_MONOTONIC ns, same moment */
+	unsigned int qc;	/* fields removed by quality control, see qc.h */
+} OBSERVATION;
+
+/* samples of one upload interval, gusts are taken from every sample */
+typedef struct {
+	int count;
+	long start;		/* health_now() of the first sample */
+	double speedsum;
+	int speedcount;
+	float gust;
+	double dirx, diry;	/* sum of direction unit vectors */
+	int dircount;
+	int direction;		/* last valid value of each field */
+	float temperature, avgspeed;
+	OBSERVATION last;
+	int flags;		/* fields seen in the interval */
+	unsigned int qc;	/* quality control flags of the interval */
+} AGGREGATE;
+
+typedef struct {
+	const char *name;
+	const char *header;	/* record start, '?' matches any byte */
+	int headerlen;
+	int minlen, maxlen;	/* record length with header, without CR LF */
+	const char *init;	/* command that selects this mode, NULL if none */
+	int (*check)(const unsigned char *line, int len);
+	int (*decode)(const unsigned char *line, int len, OBSERVATION *obs);
+} STATION;
+
+typedef struct {
+	const STATION *drv;	/* NULL until a record identifies the station */
+	const STATION *match;	/* driver whose header framed the last line */
+	unsigned char buf[256];
+	int len;
+} FRAMER;
+
+const STATION *station_find(const char *name);
+void station_framer_init(FRAMER *fr, const STATION *drv);
+int station_frame(FRAMER *fr, unsigned char *line, int *len);
+int station_decode(FRAMER *fr, const unsigned char *line, int len, OBSERVATION *obs);
+int station_format(const OBSERVATION *obs, char *out, int max);
+void station_aggregate_add(AGGREGATE *a, const OBSERVATION *obs, long now);
+int station_aggregate_take(AGGREGATE *a, OBSERVATION *obs);
+
+#endif
@@ -0,0 +1,398 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		upload.c
+  @brief	HTTP(S) uploader for wind observations
+
+  Posts observations to the web server over one persistent HTTP/1.1
+  connection, optionally TLS with session resumption, instead of starting
+  wget (and a new connection) for every sample.
+
+  Observations can be queued and sent as one batch, one line per
+  observation, optionally deflated with a preset dictionary built from the
+  line format.
+ */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "upload.h"
+
+/* preset dictionary for batch compression. deflate only references the last
+   32k so the dictionary is short: the field names in upload order and typical
+   values, with the most common strings last where matches are cheapest.
+   It is written by hand from the line format, not trained on recorded lines:
+   the field names are fixed and make up most of a line, and the values are
+   short numbers that any recorded sample would only cover partly. The zlib
+   header and the UPLOAD_DICT_HEADER header carry its adler32 (DICTID), so
+   the server can tell which dictionary to pass to inflateSetDictionary().
+   Changing a byte here needs the same change on the server */
+static const char upload_dict[] =
+	"temp=-0.5&avgspeed=12.5&gust=14.7\n"
+	"speed=7.3&dir=315&temp=21.6&avgspeed=6.9&gust=9.2\n"
+	"speed=4.2&dir=270&temp=14.4&avgspeed=3.8&gust=6.1\n"
+	"speed=1.1&dir=225&temp=8.3&avgspeed=1.4&gust=1.9\n"
+	"speed=0.0&dir=180&temp=2.2&avgspeed=0.0&gust=0.0\n"
+	"speed=3.6&dir=90&temp=11.1&avgspeed=2.5&gust=4.4\n"
+	"speed=5.0&dir=45&temp=16.7&avgspeed=5.3&gust=7.5&t=1735000000.500&m=86400.500\n"
+	"speed=2.8&dir=0&temp=10.0&avgspeed=2.2&gust=3.3&t=1790000000.250&m=3600.250\n";
+
+static void base64(const unsigned char *in, int len, char *out)
+{
+	static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	int i;
+
+	for(i=0; i<len; i+=3) {
+		*out++ = table[in[i] >> 2];
+		*out++ = table[((in[i] & 3) << 4) | (i+1 < len ? in[i+1] >> 4 : 0)];
+		*out++ = i+1 < len ? table[((in[i+1] & 15) << 2) | (i+2 < len ? in[i+2] >> 6 : 0)] : '=';
+		*out++ = i+2 < len ? table[in[i+2] & 63] : '=';
+	}
+	*out = '\0';
+}
+
+int upload_init(UPLOADER *up, const char *url, const char *user, const char *password, const char *cafile)
+{
+	char userpass[128];
+	const char *host, *end;
+	int len;
+
+	memset(up, 0, sizeof(UPLOADER));
+	up->fd = -1;
+	up->conn.fd = -1;
+
+	if(strncmp(url, "https://", 8) == 0) {
+		up->tls = 1;
+		up->port = 443;
+		host = url + 8;
+	}
+	else if(strncmp(url, "http://", 7) == 0) {
+		up->port = 80;
+		host = url + 7;
+	}
+	else {
+		return UPLOAD_ERROR_URL;
+	}
+
+	/* host[:port][/path], bracketed IPv6 literals allowed */
+	end = host + strcspn(host, "/");
+	if(*host == '[') {
+		len = strcspn(host, "]");
+		if(host + len >= end)
+			return UPLOAD_ERROR_URL;
+		if(host[len+1] == ':')
+			up->port = atoi(host + len + 2);
+		host++;
+		len--;
+	}
+	else {
+		len = strcspn(host, ":/");
+		if(host[len] == ':')
+			up->port = atoi(host + len + 1);
+	}
+	if(len <= 0 || len >= (int)sizeof(up->host) || up->port <= 0)
+		return UPLOAD_ERROR_URL;
+	memcpy(up->host, host, len);
+	up->host[len] = '\0';
+	snprintf(up->path, sizeof(up->path), "%s", *end ? end : "/");
+
+	if(user != NULL && user[0] != '\0') {
+		len = snprintf(userpass, sizeof(userpass), "%s:%s", user, password ? password : "");
+		if(len >= (int)sizeof(userpass))
+			return UPLOAD_ERROR_URL;
+		base64((unsigned char *)userpass, len, up->auth);
+	}
+
+	if(up->tls && TLSInit(&up->conn, cafile) != TLS_OK)
+		return UPLOAD_ERROR_CONNECT;
+
+	if(deflateInit2(&up->zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		upload_close(up);
+		return UPLOAD_ERROR_DEFLATE;
+	}
+	up->compress = 1;
+	up->dictid = adler32(adler32(0L, Z_NULL, 0), (const Bytef *)upload_dict, sizeof(upload_dict) - 1);
+
+	return UPLOAD_OK;
+}
+
+static int upload_connect(UPLOADER *up)
+{
+	if(up->tls) {
+		if(up->conn.ssl != NULL)
+			return UPLOAD_OK;
+		if(TLSConnect(&up->conn, up->host, up->port, UPLOAD_TIMEOUT) != TLS_OK)
+			return UPLOAD_ERROR_CONNECT;
+		printf("Connected to %s:%d (TLS session %s)\n", up->host, up->port, up->conn.resumed ? "resumed" : "new");
+	}
+	else {
+		if(up->fd >= 0)
+			return UPLOAD_OK;
+		if(TCPClientOpen(&up->fd, up->host, up->port, UPLOAD_TIMEOUT) < 0)
+			return UPLOAD_ERROR_CONNECT;
+		printf("Connected to %s:%d\n", up->host, up->port);
+	}
+	return UPLOAD_OK;
+}
+
+static void upload_disconnect(UPLOADER *up)
+{
+	if(up->tls) {
+		TLSClose(&up->conn);
+	}
+	else if(up->fd >= 0) {
+		TCPClientClose(up->fd);
+		up->fd = -1;
+	}
+}
+
+static int upload_write(UPLOADER *up, char *buf, int len)
+{
+	int ret;
+
+	while(len > 0) {
+		ret = up->tls ? TLSWrite(&up->conn, buf, len) : TCPWrite(up->fd, buf, len);
+		if(ret <= 0)
+			return -1;
+		buf += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static int upload_read(UPLOADER *up, char *buf, int len)
+{
+	return up->tls ? TLSBlockRead(&up->conn, buf, len) : TCPBlockRead(up->fd, buf, len);
+}
+
+/* next byte of a response, buf holds len bytes read so far of which pos
+   are used. returns the byte, -1 when the connection failed */
+static int upload_byte(UPLOADER *up, char *buf, int size, int *pos, int *len)
+{
+	if(*pos >= *len) {
+		*len = upload_read(up, buf, size);
+		*pos = 0;
+		if(*len <= 0)
+			return -1;
+	}
+	return (unsigned char)buf[(*pos)++];
+}
+
+/* read a CRLF terminated line, longer lines are cut to max-1 bytes */
+static int upload_line(UPLOADER *up, char *buf, int size, int *pos, int *len, char *line, int max)
+{
+	int c, n = 0;
+
+	while((c = upload_byte(up, buf, size, pos, len)) != '\n') {
+		if(c < 0)
+			return -1;
+		if(c != '\r' && n < max - 1)
+			line[n++] = c;
+	}
+	line[n] = '\0';
+	return n;
+}
+
+/* discard a chunked body (RFC 7230 4.1): size lines in hex, each chunk
+   followed by CRLF, up to the last chunk of size 0 and the empty line
+   that ends its trailers */
+static int upload_skip_chunked(UPLOADER *up, char *buf, int size, int pos, int len)
+{
+	char line[128], *end;
+	long chunk;
+
+	while(1) {
+		if(upload_line(up, buf, size, &pos, &len, line, sizeof(line)) < 0)
+			return UPLOAD_ERROR_IO;
+		chunk = strtol(line, &end, 16);
+		if(end == line || chunk < 0)
+			return UPLOAD_ERROR_HTTP;
+		if(chunk == 0)
+			break;
+		for(; chunk > 0; chunk--) {
+			if(upload_byte(up, buf, size, &pos, &len) < 0)
+				return UPLOAD_ERROR_IO;
+		}
+		if(upload_line(up, buf, size, &pos, &len, line, sizeof(line)) != 0)
+			return UPLOAD_ERROR_HTTP;
+	}
+
+	do {
+		if(upload_line(up, buf, size, &pos, &len, line, sizeof(line)) < 0)
+			return UPLOAD_ERROR_IO;
+	} while(line[0] != '\0');
+
+	return UPLOAD_OK;
+}
+
+/* read one response, leaving the connection ready for the next request */
+static int upload_response(UPLOADER *up)
+{
+	char buf[1024], *hdrend, *p;
+	int len = 0, ret, length = -1, keepalive = 1, chunked = 0, body;
+
+	do {
+		if(len >= (int)sizeof(buf) - 1)
+			return UPLOAD_ERROR_HTTP;
+		ret = upload_read(up, buf + len, sizeof(buf) - 1 - len);
+		if(ret <= 0)
+			return UPLOAD_ERROR_IO;
+		len += ret;
+		buf[len] = '\0';
+	} while((hdrend = strstr(buf, "\r\n\r\n")) == NULL);
+
+	if(sscanf(buf, "HTTP/1.%*d %d", &up->status) != 1)
+		return UPLOAD_ERROR_HTTP;
+
+	*hdrend = '\0';
+	for(p = strstr(buf, "\r\n"); p != NULL; p = strstr(p + 2, "\r\n")) {
+		if(strncasecmp(p + 2, "Content-Length:", 15) == 0)
+			length = atoi(p + 17);
+		else if(strncasecmp(p + 2, "Connection:", 11) == 0 && strstr(p + 13, "close") != NULL)
+			keepalive = 0;
+		else if(strncasecmp(p + 2, "Transfer-Encoding:", 18) == 0 && strstr(p + 20, "chunked") != NULL)
+			chunked = 1;
+	}
+
+	/* discard the body so the next response starts at a clean boundary,
+	   PHP backends usually answer chunked */
+	if(chunked) {
+		ret = upload_skip_chunked(up, buf, sizeof(buf) - 1, (int)(hdrend + 4 - buf), len);
+		if(ret != UPLOAD_OK) {
+			upload_disconnect(up);
+			return ret;
+		}
+	}
+	else if(length < 0) {
+		keepalive = 0;
+	}
+	else {
+		body = len - (int)(hdrend + 4 - buf);
+		while(body < length) {
+			ret = upload_read(up, buf, (length - body) < (int)sizeof(buf) ? (length - body) : (int)sizeof(buf));
+			if(ret <= 0)
+				return UPLOAD_ERROR_IO;
+			body += ret;
+		}
+	}
+
+	if(!keepalive)
+		upload_disconnect(up);
+
+	if(up->status < 200 || up->status > 299)
+		return UPLOAD_ERROR_HTTP;
+
+	return UPLOAD_OK;
+}
+
+static int upload_request(UPLOADER *up, const char *type, const char *encoding, const char *body, int len)
+{
+	char request[768 + UPLOAD_BATCH_SIZE + 64];
+	int hlen, ret, attempt;
+
+	hlen = snprintf(request, 768, "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Type: %s\r\n",
+		up->path, up->host, type);
+	if(up->auth[0] != '\0')
+		hlen += snprintf(request + hlen, 768 - hlen, "Authorization: Basic %s\r\n", up->auth);
+	if(encoding != NULL)
+		hlen += snprintf(request + hlen, 768 - hlen, "Content-Encoding: %s\r\n%s: %08lx\r\n",
+				 encoding, UPLOAD_DICT_HEADER, up->dictid);
+	hlen += snprintf(request + hlen, 768 - hlen, "Content-Length: %d\r\n\r\n", len);
+	if(hlen >= 768 || len > (int)sizeof(request) - hlen)
+		return UPLOAD_ERROR_URL;
+
+	/* header and body in one write, a separate small body segment would wait
+	   for the delayed ack of the header (Nagle) and cost an extra packet */
+	memcpy(request + hlen, body, len);
+
+	/* a kept-alive connection may have been closed by the server while idle,
+	   so an I/O error on it is retried once on a fresh connection. A read or
+	   write timeout is an I/O error too and closes the connection */
+	for(attempt=0; attempt<2; attempt++) {
+		ret = upload_connect(up);
+		if(ret != UPLOAD_OK)
+			return ret;
+
+		if(upload_write(up, request, hlen + len) == 0) {
+			ret = upload_response(up);
+			if(ret != UPLOAD_ERROR_IO)
+				return ret;
+		}
+		else {
+			ret = UPLOAD_ERROR_IO;
+		}
+		upload_disconnect(up);
+	}
+	return ret;
+}
+
+int upload_post(UPLOADER *up, const char *body, int len)
+{
+	return upload_request(up, "application/x-www-form-urlencoded", NULL, body, len);
+}
+
+/* add one observation line to the batch */
+int upload_queue(UPLOADER *up, const char *line, int len)
+{
+	if(up->batchlen + len + 1 > UPLOAD_BATCH_SIZE)
+		return UPLOAD_ERROR_FULL;
+
+	memcpy(up->batch + up->batchlen, line, len);
+	up->batchlen += len;
+	up->batch[up->batchlen++] = '\n';
+	up->batchcount++;
+	return UPLOAD_OK;
+}
+
+/* send the batch, it is kept for the next attempt if sending fails */
+int upload_flush(UPLOADER *up)
+{
+	unsigned char out[UPLOAD_BATCH_SIZE + 64];
+	int ret, len;
+
+	if(up->batchcount == 0)
+		return UPLOAD_OK;
+
+	if(up->compress && !up->plain && up->zs.state != Z_NULL) {
+		if(deflateReset(&up->zs) != Z_OK ||
+		   deflateSetDictionary(&up->zs, (const Bytef *)upload_dict, sizeof(upload_dict) - 1) != Z_OK)
+			return UPLOAD_ERROR_DEFLATE;
+
+		up->zs.next_in = (Bytef *)up->batch;
+		up->zs.avail_in = up->batchlen;
+		up->zs.next_out = out;
+		up->zs.avail_out = sizeof(out);
+		if(deflate(&up->zs, Z_FINISH) != Z_STREAM_END)
+			return UPLOAD_ERROR_DEFLATE;
+		len = sizeof(out) - up->zs.avail_out;
+
+		ret = upload_request(up, "text/plain", UPLOAD_ENCODING, (char *)out, len);
+
+		/* unsupported media type, the server can't inflate the body */
+		if(ret == UPLOAD_ERROR_HTTP && up->status == 415) {
+			printf("Server refused compressed uploads, sending them uncompressed\n");
+			up->plain = 1;
+		}
+	}
+	if(!up->compress || up->plain || up->zs.state == Z_NULL) {
+		len = up->batchlen;
+		ret = upload_request(up, "text/plain", NULL, up->batch, len);
+	}
+
+	if(ret == UPLOAD_OK) {
+		up->rawbytes += up->batchlen;
+		up->sentbytes += len;
+		up->batchlen = 0;
+		up->batchcount = 0;
+	}
+	return ret;
+}
+
+void upload_close(UPLOADER *up)
+{
+	upload_disconnect(up);
+	if(up->tls)
+		TLSFree(&up->conn);
+	if(up->zs.state != Z_NULL)
+		deflateEnd(&up->zs);
+}
@@ -0,0 +1,69 @@
+/*---------------------------------------------------------------------------*/
+/**
+  @file		upload.h
+  @brief	HTTP(S) uploader for wind observations
+
+  Posts observations to the web server over one persistent HTTP/1.1
+  connection, optionally TLS with session resumption, instead of starting
+  wget (and a new connection) for every sample.
+
+  Observations can be queued and sent as one batch, one line per
+  observation, optionally deflated with a preset dictionary built from the
+  line format.
+
+  A compressed body is a zlib stream (RFC 1950) that needs the dictionary,
+  which no stock HTTP stack has, so it is sent with the private
+  Content-Encoding UPLOAD_ENCODING and the dictionary's adler32 in the
+  UPLOAD_DICT_HEADER header. The server must call inflateSetDictionary()
+  with exactly the bytes of upload_dict in upload.c when inflate() returns
+  Z_NEED_DICT. A server that answers 415 gets uncompressed bodies from
+  then on.
+ */
+/*---------------------------------------------------------------------------*/
+
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <zlib.h>
+#include "tls.h"
+
+#define UPLOAD_TIMEOUT 10000	/* ms, connect timeout and limit for each read or write */
+#define UPLOAD_BATCH_SIZE 32768	/* bytes of queued observation lines, BUDGET_MAX_BATCH of them */
+#define UPLOAD_ENCODING "x-getwind-deflate-dict"	/* Content-Encoding of compressed bodies */
+#define UPLOAD_DICT_HEADER "X-Getwind-Dictionary"	/* adler32 of the dictionary, 8 hex digits */
+
+#define UPLOAD_OK 0
+#define UPLOAD_ERROR_URL -1	/* malformed or unsupported url */
+#define UPLOAD_ERROR_CONNECT -2	/* connect or TLS handshake failed */
+#define UPLOAD_ERROR_IO -3	/* connection lost during request */
+#define UPLOAD_ERROR_HTTP -4	/* malformed response or non 2xx status */
+#define UPLOAD_ERROR_FULL -5	/* batch buffer full, flush first */
+#define UPLOAD_ERROR_DEFLATE -6	/* compression failed */
+
+typedef struct {
+	char host[128];
+	char path[256];
+	char auth[192];		/* base64 of user:password, empty for none */
+	int port;
+	int tls;
+	int fd;			/* plain http socket, -1 when closed */
+	TLSConn conn;
+	int status;		/* last http status */
+	char batch[UPLOAD_BATCH_SIZE];
+	int batchlen;
+	int batchcount;		/* lines in batch */
+	int compress;		/* deflate batches */
+	int plain;		/* the server refused compressed bodies (415) */
+	unsigned long dictid;	/* adler32 of the dictionary */
+	z_stream zs;
+	unsigned long rawbytes;	/* batch bytes before compression */
+	unsigned long sentbytes;	/* batch bytes after compression */
+} UPLOADER;
+
+int upload_init(UPLOADER *up, const char *url, const char *user, const char *password, const char *cafile);
+int upload_post(UPLOADER *up, const char *body, int len);
+int upload_queue(UPLOADER *up, const char *line, int len);
+int upload_flush(UPLOADER *up);
+void upload_close(UPLOADER *up);
+
+#endif
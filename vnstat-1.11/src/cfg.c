@@ -99,6 +99,10 @@ void printcfgfile(void)
 	printf("# force data save when interface status changes (1 = enabled, 0 = disabled)\n");
 	printf("SaveOnStatusChange %d\n\n", cfg.savestatus);
 
+	printf("# how often (in milliseconds) rates are sampled for the per minute\n");
+	printf("# peak and 95th percentile (0 = disabled, 50-1000)\n");
+	printf("SampleInterval %d\n\n", cfg.sampleinterval);
+
 	printf("# enable / disable logging (0 = disabled, 1 = logfile, 2 = syslog)\n");
 	printf("UseLogging %d\n\n", cfg.uselogging);
 
@@ -179,6 +183,7 @@ int loadcfg(const char *cfgfile)
 		{ "SaveInterval", 0, &cfg.saveinterval, 0, 0 },
 		{ "OfflineSaveInterval", 0, &cfg.offsaveinterval, 0, 0 },
 		{ "SaveOnStatusChange", 0, &cfg.savestatus, 0, 0 },
+		{ "SampleInterval", 0, &cfg.sampleinterval, 0, 0 },
 		{ "UseLogging", 0, &cfg.uselogging, 0, 0 },
 		{ "LogFile", cfg.logfile, 0, 512, 0 },
 		{ "PidFile", cfg.pidfile, 0, 512, 0 },
@@ -444,6 +449,12 @@ void validatecfg(void)
 		printe(PT_Config);
 	}
 
+	if (cfg.sampleinterval!=0 && (cfg.sampleinterval<50 || cfg.sampleinterval>1000)) {
+		cfg.sampleinterval = SAMPLEINTERVAL;
+		snprintf(errorstring, 512, "Invalid value for SampleInterval, resetting to \"%d\".", cfg.sampleinterval);
+		printe(PT_Config);
+	}
+
 	if (cfg.uselogging<0 || cfg.uselogging>2) {
 		cfg.uselogging = USELOGGING;
 		snprintf(errorstring, 512, "Invalid value for UseLogging, resetting to \"%d\".", cfg.uselogging);
@@ -528,6 +539,7 @@ void defaultcfg(void)
 	cfg.saveinterval = SAVEINTERVAL;
 	cfg.offsaveinterval = OFFSAVEINTERVAL;
 	cfg.savestatus = SAVESTATUS;
+	cfg.sampleinterval = SAMPLEINTERVAL;
 	cfg.uselogging = USELOGGING;
 	strncpy(cfg.logfile, LOGFILE, 512);
 	strncpy(cfg.pidfile, PIDFILE, 512);
@@ -1,5 +1,68 @@
 #include "common.h"
 
+/* storage behind errorstring and ifinfo, the main thread uses the static one */
+typedef struct {
+	char error[512];
+	IFINFO info;
+} THREADLOCAL;
+
+static THREADLOCAL mainlocal;
+static pthread_key_t localkey;
+static pthread_once_t localonce = PTHREAD_ONCE_INIT;
+static int localkeyok = 0;
+static pthread_mutex_t printlock = PTHREAD_MUTEX_INITIALIZER;
+
+static void threadlocalkey(void)
+{
+	localkeyok = (pthread_key_create(&localkey, free)==0);
+}
+
+static THREADLOCAL *threadlocal(void)
+{
+	THREADLOCAL *t;
+
+	pthread_once(&localonce, threadlocalkey);
+
+	if (localkeyok && (t=pthread_getspecific(localkey))!=NULL) {
+		return t;
+	}
+
+	return &mainlocal;
+}
+
+/* give the calling thread its own errorstring and ifinfo, returns 0 on failure */
+int threadlocalinit(void)
+{
+	THREADLOCAL *t;
+
+	pthread_once(&localonce, threadlocalkey);
+
+	if (!localkeyok) {
+		return 0;
+	}
+
+	if ((t=calloc(1, sizeof(THREADLOCAL)))==NULL) {
+		return 0;
+	}
+
+	if (pthread_setspecific(localkey, t)!=0) {
+		free(t);
+		return 0;
+	}
+
+	return 1;
+}
+
+char *errorbuffer(void)
+{
+	return threadlocal()->error;
+}
+
+IFINFO *ifinfobuffer(void)
+{
+	return &threadlocal()->info;
+}
+
 int printe(PrintType type)
 {
 	int result = 1;
@@ -7,9 +70,13 @@ int printe(PrintType type)
 	/* daemon running but log not enabled */
 	if (noexit==2 && cfg.uselogging==0) {
 		return 1;
+	}
+
+	/* messages from different threads don't get mixed */
+	pthread_mutex_lock(&printlock);
 
 	/* daemon running, log enabled */
-	} else if (noexit==2) {
+	if (noexit==2) {
 
 		switch (type) {
 			case PT_Multiline:
@@ -44,6 +111,8 @@ int printe(PrintType type)
 
 	}
 
+	pthread_mutex_unlock(&printlock);
+
 	return result;
 }
 
@@ -51,6 +120,7 @@ int logprint(PrintType type)
 {
 	char timestamp[22], buffer[512];
 	time_t current;
+	struct tm tm;
 	FILE *logfile;
 
 	/* logfile */
@@ -61,7 +131,7 @@ int logprint(PrintType type)
 		}
 
 		current = time(NULL);
-		strftime(timestamp, 22, "%Y.%m.%d %H:%M:%S", localtime(&current));
+		strftime(timestamp, 22, "%Y.%m.%d %H:%M:%S", localtime_r(&current, &tm));
 
 		switch (type) {
 			case PT_Info:
@@ -130,11 +200,12 @@ int dmonth(int month)
 	static int dmon[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
 	int year;
 	time_t current;
+	struct tm tm;
 
 	/* handle leap years */
 	if (month==1) {
 		current = time(NULL);
-		year = localtime(&current)->tm_year;
+		year = localtime_r(&current, &tm)->tm_year;
 		if ( ((year % 4 == 0) && (year % 100 != 0)) || (year % 400 == 0) ) {
 			return 29;
 		} else {
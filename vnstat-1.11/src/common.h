@@ -19,6 +19,17 @@
 #include <inttypes.h>
 #include <syslog.h>
 #include <sys/statvfs.h>
+#include <pthread.h>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+#include <sys/timerfd.h>
+#endif
 
 #if defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) || defined(__FreeBSD_kernel__)
 #include <sys/param.h>
@@ -124,6 +135,15 @@ and most can be changed later from the config file.
 /* each try takes about a second */
 #define LOCKTRYLIMIT 5
 
+/* journal bytes after which the database is written in full again */
+#define JOURNALMAX 16384
+
+/* equal bytes between two changes that are still written as one range */
+#define JOURNALGAP 8
+
+/* journal file version */
+#define JOURNALVERSION 1
+
 /* database version */
 /* 1 = 1.0, 2 = 1.1-1.2, 3 = 1.3- */
 #define DBVERSION 3
@@ -149,6 +169,9 @@ and most can be changed later from the config file.
 /* /proc/net/dev */
 #define PROCNETDEV "/proc/net/dev"
 
+/* link notifications handled per wakeup, more mean a full interface check */
+#define LINKEVENTS 64
+
 /* daemon defaults */
 #define UPDATEINTERVAL 30
 #define POLLINTERVAL 5
@@ -159,6 +182,18 @@ and most can be changed later from the config file.
 #define LOGFILE "/var/log/vnstat.log"
 #define PIDFILE "/var/run/vnstat.pid"
 
+/* rate sampling interval (ms), 0 = disabled */
+#define SAMPLEINTERVAL 0
+
+/* minutes of sampled rates kept per interface */
+#define RATEMINUTES 1440
+
+/* rates file version */
+#define RATESVERSION 1
+
+/* worker threads updating and saving interfaces next to the main thread */
+#define UPDATETHREADS 4
+
 /* no transparency by default */
 #define TRANSBG 0
 
@@ -189,6 +224,7 @@ typedef struct {
 	short monthrotate, maxbw, flock, spacecheck, traflessday, transbg, slayout;
 	char logfile[512], pidfile[512];
 	short updateinterval, pollinterval, saveinterval, offsaveinterval, savestatus, uselogging;
+	short sampleinterval;
 } CFG;
 
 /* internal interface information structure */
@@ -201,6 +237,26 @@ typedef struct {
 	uint64_t txp;
 } IFINFO;
 
+/* counters of all interfaces from one netlink dump or read of /proc/net/dev */
+typedef struct {
+	char name[32];
+	int index;              /* kernel ifindex, 0 if read from /proc */
+	uint64_t rx, tx, rxp, txp;
+} IFSNAPENTRY;
+
+typedef struct {
+	int count, size;        /* entries in use, entries allocated */
+	int valid;              /* last read succeeded */
+	int shared;             /* lookups use the table until the next read (daemon) */
+	IFSNAPENTRY *entry;
+} IFSNAP;
+
+/* link notification: an interface appeared (or changed) or disappeared */
+typedef struct {
+	char name[32];
+	int exists;
+} LINKEVENT;
+
 typedef struct {
 	time_t date;
 	uint64_t rx, tx;
@@ -236,6 +292,47 @@ typedef struct {
 	uint64_t btime;
 } DATA;
 
+/* peak and 95th percentile rate of one minute in bytes per second */
+typedef struct {
+	time_t minute;
+	uint32_t rxpeak, txpeak, rxp95, txp95;
+} MINUTERATE;
+
+/* ring of sampled minutes, saved in "dbdir/.iface.rates" */
+typedef struct {
+	int version;
+	char interface[32];
+	int sampleinterval;     /* ms */
+	int next;               /* slot of the next minute */
+	MINUTERATE minute[RATEMINUTES];
+} RATES;
+
+/* rate samples of the current minute, daemon only */
+typedef struct {
+	RATES rates;
+	time_t minute;
+	uint64_t rx, tx;        /* counters at the previous sample */
+	uint64_t ms;            /* monotonic time of the previous sample */
+	int primed;             /* previous sample exists */
+	int count, size;
+	uint32_t *rxsample, *txsample;
+} RATETRACK;
+
+/* journal of database changes, "dbdir/.iface.journal" */
+typedef struct {
+	int version;
+	uint32_t base;          /* crc of the database file the saves apply to */
+} JOURNALHEAD;
+
+/* one changed byte range of DATA, the bytes follow. a save ends with
+   a record of length 0 whose crc covers all records of the save. getwind
+   reads the database without the lock and relies on these crcs and the
+   head base to skip a save that is still being written */
+typedef struct {
+	uint16_t offset, length;
+	uint32_t crc;           /* of the bytes, of the save when length is 0 */
+} JOURNALREC;
+
 typedef struct ibwnode {
 	char interface[32];
 	int limit;
@@ -255,12 +352,18 @@ int printe(PrintType type);
 int logprint(PrintType type);
 int dmonth(int month);
 uint32_t mosecs(void);
+int threadlocalinit(void);
+char *errorbuffer(void);
+IFINFO *ifinfobuffer(void);
+
+/* errorstring and ifinfo are per thread, the daemon updates interfaces from several threads */
+#define errorstring (errorbuffer())
+#define ifinfo (*ifinfobuffer())
 
 /* global variables */
 DATA data;
 CFG cfg;
-IFINFO ifinfo;
-char errorstring[512];
+IFSNAP ifsnap;
 ibwnode *ifacebw;
 int debug;
 int noexit;      /* = running as daemon if 2 */
@@ -1,11 +1,12 @@
 #include "common.h"
 #include "dbaccess.h"
 
-int readdb(const char *iface, const char *dirname)
+int readdb(DATA *data, const char *iface, const char *dirname)
 {
 	FILE *db;
 	char file[512], backup[512];
-	int newdb=0;
+	int newdb=0, journal=0;
+	uint32_t base=0;
 
 	snprintf(file, 512, "%s/%s", dirname, iface);
 	snprintf(backup, 512, "%s/.%s", dirname, iface);
@@ -17,25 +18,29 @@ int readdb(const char *iface, const char *dirname)
 			return -1;
 		}
 
-		if (fread(&data,sizeof(DATA),1,db)==0) {
-			data.version=-1;
+		if (fread(data,sizeof(DATA),1,db)==0) {
+			data->version=-1;
 			if (debug) {
 				printf("db: Database read failed for file \"%s\".\n", file);
 			}
 		} else {
+			/* a journal applies only to the exact bytes it was started for */
+			base=dbcrc(0, data, sizeof(DATA));
+			journal=1;
 			if (debug) {
-				printf("db: Database loaded for interface \"%s\"...\n", data.interface);
+				printf("db: Database loaded for interface \"%s\"...\n", data->interface);
 			}
 		}
 
 		/* convert old database to new format if necessary */
-		if (data.version<DBVERSION) {
-			if (data.version!=-1) {
-				snprintf(errorstring, 512, "Trying to convert database \"%s\" (v%d) to current db format", file, data.version);
+		if (data->version<DBVERSION) {
+			journal=0;
+			if (data->version!=-1) {
+				snprintf(errorstring, 512, "Trying to convert database \"%s\" (v%d) to current db format", file, data->version);
 				printe(PT_Info);
 			}
 
-			if ((data.version==-1) || (!convertdb(db))) {
+			if ((data->version==-1) || (!convertdb(data, db))) {
 
 				/* close current db and try using backup if database conversion failed */
 				fclose(db);
@@ -47,7 +52,7 @@ int readdb(const char *iface, const char *dirname)
 						return -1;
 					}
 
-					if (fread(&data,sizeof(DATA),1,db)==0) {
+					if (fread(data,sizeof(DATA),1,db)==0) {
 						snprintf(errorstring, 512, "Database load failed even when using backup. Aborting.");
 						printe(PT_Error);
 						fclose(db);
@@ -59,12 +64,12 @@ int readdb(const char *iface, const char *dirname)
 						}
 					} else {
 						if (debug) {
-							printf("db: Database loaded for interface \"%s\"...\n", data.interface);
+							printf("db: Database loaded for interface \"%s\"...\n", data->interface);
 						}
 					}
 
-					if (data.version!=DBVERSION) {
-						if (!convertdb(db)) {
+					if (data->version!=DBVERSION) {
+						if (!convertdb(data, db)) {
 							snprintf(errorstring, 512, "Unable to use backup database.");
 							printe(PT_Error);
 							fclose(db);
@@ -89,8 +94,8 @@ int readdb(const char *iface, const char *dirname)
 				}
 			}
 
-		} else if (data.version>DBVERSION) {
-			snprintf(errorstring, 512, "Downgrading database \"%s\" (v%d) is not supported.", file, data.version);
+		} else if (data->version>DBVERSION) {
+			snprintf(errorstring, 512, "Downgrading database \"%s\" (v%d) is not supported.", file, data->version);
 			printe(PT_Error);
 			fclose(db);
 
@@ -103,92 +108,97 @@ int readdb(const char *iface, const char *dirname)
 
 		fclose(db);
 
-		if (strcmp(data.interface,iface)) {
-			snprintf(errorstring, 512, "Warning:\nThe previous interface for this file was \"%s\".",data.interface);
+		/* add the changes saved after the database was written */
+		if (journal) {
+			readjournal(data, base, iface, dirname);
+		}
+
+		if (strcmp(data->interface,iface)) {
+			snprintf(errorstring, 512, "Warning:\nThe previous interface for this file was \"%s\".",data->interface);
 			printe(PT_Multiline);
 			snprintf(errorstring, 512, "It has now been replaced with \"%s\".",iface);
 			printe(PT_Multiline);
 			snprintf(errorstring, 512, "You can ignore this message if you renamed the filename.");
 			printe(PT_Multiline);
-			snprintf(errorstring, 512, "Interface name mismatch, renamed \"%s\" -> \"%s\"", data.interface, iface);
+			snprintf(errorstring, 512, "Interface name mismatch, renamed \"%s\" -> \"%s\"", data->interface, iface);
 			printe(PT_ShortMultiline);
-			if (strcmp(data.interface, data.nick)==0) {
-				strncpy(data.nick, iface, 32);
+			if (strcmp(data->interface, data->nick)==0) {
+				strncpy(data->nick, iface, 32);
 			}
-			strncpy(data.interface, iface, 32);
+			strncpy(data->interface, iface, 32);
 		}
 	} else {
 		snprintf(errorstring, 512, "Unable to read database \"%s\".",file);
 		printe(PT_Error);
 
 		newdb=1;
-		initdb();
-		strncpy(data.interface, iface, 32);
-		strncpy(data.nick, data.interface, 32);
+		initdb(data);
+		strncpy(data->interface, iface, 32);
+		strncpy(data->nick, data->interface, 32);
 	}
 	return newdb;
 }
 
-void initdb(void)
+void initdb(DATA *data)
 {
 	int i;
 	time_t current;
-	struct tm *d;
+	struct tm *d, tm;
 
 	current=time(NULL);
-	d=localtime(&current);
+	d=localtime_r(&current, &tm);
 
 	/* set default values for a new database */
-	data.version=DBVERSION;
-	data.active=1;
-	data.totalrx=0;
-	data.totaltx=0;
-	data.currx=0;
-	data.curtx=0;
-	data.totalrxk=0;
-	data.totaltxk=0;
-	data.lastupdated=current;
-	data.created=current;
+	data->version=DBVERSION;
+	data->active=1;
+	data->totalrx=0;
+	data->totaltx=0;
+	data->currx=0;
+	data->curtx=0;
+	data->totalrxk=0;
+	data->totaltxk=0;
+	data->lastupdated=current;
+	data->created=current;
 
 	/* days */
 	for (i=0;i<=29;i++) {
-		data.day[i].rx=0;
-		data.day[i].tx=0;
-		data.day[i].rxk=0;
-		data.day[i].txk=0;
-		data.day[i].date=0;
-		data.day[i].used=0;
+		data->day[i].rx=0;
+		data->day[i].tx=0;
+		data->day[i].rxk=0;
+		data->day[i].txk=0;
+		data->day[i].date=0;
+		data->day[i].used=0;
 	}
 
 	/* months */
 	for (i=0;i<=11;i++) {
-		data.month[i].rx=0;
-		data.month[i].tx=0;
-		data.month[i].rxk=0;
-		data.month[i].txk=0;
-		data.month[i].month=0;
-		data.month[i].used=0;
+		data->month[i].rx=0;
+		data->month[i].tx=0;
+		data->month[i].rxk=0;
+		data->month[i].txk=0;
+		data->month[i].month=0;
+		data->month[i].used=0;
 	}
 
 	/* top10 */
 	for (i=0;i<=9;i++) {
-		data.top10[i].rx=0;
-		data.top10[i].tx=0;
-		data.top10[i].rxk=0;
-		data.top10[i].txk=0;
-		data.top10[i].date=0;
-		data.top10[i].used=0;
+		data->top10[i].rx=0;
+		data->top10[i].tx=0;
+		data->top10[i].rxk=0;
+		data->top10[i].txk=0;
+		data->top10[i].date=0;
+		data->top10[i].used=0;
 	}
 
 	/* hours */
 	for (i=0;i<=23;i++) {
-		data.hour[i].rx=0;
-		data.hour[i].tx=0;
-		data.hour[i].date=0;
+		data->hour[i].rx=0;
+		data->hour[i].tx=0;
+		data->hour[i].date=0;
 	}
 
-	data.day[0].used=data.month[0].used=1;
-	data.day[0].date=current;
+	data->day[0].used=data->month[0].used=1;
+	data->day[0].date=current;
 
 	/* calculate new date for current month if current day is less
            than the set monthrotate value so that new databases begin
@@ -196,67 +206,142 @@ void initdb(void)
 	if (d->tm_mday < cfg.monthrotate) {
 		d->tm_mday=cfg.monthrotate;
 		d->tm_mon--;
-		data.month[0].month=mktime(d);
+		data->month[0].month=mktime(d);
 	} else {
-		data.month[0].month=current;
+		data->month[0].month=current;
 	}
 
-	data.btime=FP32;
+	data->btime=FP32;
 }
 
-int writedb(const char *iface, const char *dirname, int newdb)
+int writedb(DATA *data, const char *iface, const char *dirname, int newdb)
 {
-	FILE *db;
-	char file[512], backup[512];
+	if (!writedbfile(data, iface, dirname, newdb)) {
+		return 0;
+	}
+
+	/* the rename is only durable once the directory is */
+	syncdir(dirname);
+
+	return 1;
+}
+
+/* write the database without syncing the directory, for callers saving
+   several databases that sync it once with syncdir() when done */
+int writedbfile(DATA *data, const char *iface, const char *dirname, int newdb)
+{
+	char file[512], tmp[512], backup[512];
 
 	snprintf(file, 512, "%s/%s", dirname, iface);
+	snprintf(tmp, 512, "%s/.%s.tmp", dirname, iface);
 	snprintf(backup, 512, "%s/.%s", dirname, iface);
 
-	/* try to make backup of old data if this isn't a new database */
-	if (!newdb && !backupdb(file, backup)) {
-		snprintf(errorstring, 512, "Unable create database backup \"%s\".", backup);
-		printe(PT_Error);
-		return 0;		
+	/* make sure version stays correct */
+	data->version=DBVERSION;
+
+	/* update timestamp when not merging */
+	if (newdb!=2) {
+		data->lastupdated=time(NULL);
 	}
 
-	/* make sure version stays correct */
-	data.version=DBVERSION;
+	/* the old file becomes the backup if this isn't a new database */
+	switch (replacefile(file, tmp, newdb ? NULL : backup, data, sizeof(DATA))) {
+		case 1:
+			break;
+		case -1:
+			snprintf(errorstring, 512, "Unable create database backup \"%s\".", backup);
+			printe(PT_Error);
+			return 0;
+		default:
+			snprintf(errorstring, 512, "Unable to write database \"%s\".", file);
+			printe(PT_Error);
+			return 0;
+	}
+
+	if (debug) {
+		printf("db: Database \"%s\" saved.\n", file);
+	}
+	if ((newdb) && (noexit==0)) {
+		snprintf(errorstring, 512, "-> A new database has been created.");
+		printe(PT_Info);
+	}
 
-	if ((db=fopen(file,"w"))!=NULL) {
+	return 1;
+}
 
-		/* lock file */
-		if (!lockdb(fileno(db), 1)) {
+/* replace file with len bytes from buf by writing tmp, syncing it and
+   renaming it over file, readers see either the old or the new content.
+   the old file is linked to backup first unless backup is NULL.
+   returns 1 on success, -1 if the backup failed and 0 otherwise */
+int replacefile(const char *file, const char *tmp, const char *backup, const void *buf, int len)
+{
+	struct stat fdstat, pathstat;
+	int fd, tries;
+
+	/* lock the temporary file, a writer that was waiting for the lock
+	   of a file that has since been renamed has to open it again */
+	for (tries=1; ; tries++) {
+		if ((fd=open(tmp, O_WRONLY|O_CREAT, 0666))==-1) {
 			return 0;
 		}
-
-		/* update timestamp when not merging */
-		if (newdb!=2) {
-			data.lastupdated=time(NULL);
+		if (!lockdb(fd, 1)) {
+			close(fd);
+			return 0;
 		}
-
-		if (fwrite(&data,sizeof(DATA),1,db)==0) {
-			snprintf(errorstring, 512, "Unable to write database \"%s\".", file);
-			printe(PT_Error);
+		if (fstat(fd, &fdstat)==0 && stat(tmp, &pathstat)==0 && fdstat.st_dev==pathstat.st_dev && fdstat.st_ino==pathstat.st_ino) {
+			break;
+		}
+		close(fd);
+		if (tries>=LOCKTRYLIMIT) {
 			return 0;
-		} else {
-			if (debug) {
-				printf("db: Database \"%s\" saved.\n", file);
-			}
-			fclose(db);
-			if ((newdb) && (noexit==0)) {
-				snprintf(errorstring, 512, "-> A new database has been created.");
-				printe(PT_Info);
-			}
 		}
-	} else {
-		snprintf(errorstring, 512, "Unable to write database \"%s\".", file);
-		printe(PT_Error);
+	}
+
+	if (ftruncate(fd, 0)!=0 || write(fd, buf, len)!=len || fsync(fd)!=0) {
+		unlink(tmp);
+		close(fd);
+		return 0;
+	}
+
+	/* a hard link keeps the old content without copying it */
+	if (backup!=NULL) {
+		unlink(backup);
+		if (link(file, backup)!=0 && errno!=ENOENT && !backupdb(file, backup)) {
+			unlink(tmp);
+			close(fd);
+			return -1;
+		}
+	}
+
+	if (rename(tmp, file)!=0) {
+		unlink(tmp);
+		close(fd);
 		return 0;
 	}
 
+	close(fd);
 	return 1;
 }
 
+/* make renames and new files in dirname durable */
+int syncdir(const char *dirname)
+{
+	int fd, result;
+
+	if ((fd=open(dirname, O_RDONLY))==-1) {
+		return 0;
+	}
+
+	result = (fsync(fd)==0);
+	close(fd);
+
+	if (debug) {
+		printf("db: Directory \"%s\" synced (%d).\n", dirname, result);
+	}
+
+	return result;
+}
+
 int backupdb(const char *current, const char *backup)
 {
 	FILE *bf;
@@ -290,19 +375,19 @@ int backupdb(const char *current, const char *backup)
 	return 1;
 }
 
-int convertdb(FILE *db)
+int convertdb(DATA *data, FILE *db)
 {
 	int i, days, mod;
 	DATA10 data10;
 	DATA12 data12;
 	time_t current;
-	struct tm *d;
+	struct tm *d, tm;
 	int month=0, day;
 	int tm_mday, tm_mon, tm_year;
 	int converted=0;
 
 	current=time(NULL);
-	d=localtime(&current);
+	d=localtime_r(&current, &tm);
 	days=d->tm_mday-1;
 
 	tm_mday=d->tm_mday;
@@ -310,7 +395,7 @@ int convertdb(FILE *db)
 	tm_year=d->tm_year;
 
 	/* version 1.0 database format */
-	if (data.version==1) {
+	if (data->version==1) {
 
 		snprintf(errorstring, 512, "Converting to db v2...\n");
 		printe(PT_Info);
@@ -439,7 +524,7 @@ int convertdb(FILE *db)
 		/* reset top10 if there was some problem */
 		if (month==-1) {
 			for (i=0; i<=9; i++) {
-				data12.top10[i].rx=data.top10[i].tx=0;
+				data12.top10[i].rx=data->top10[i].tx=0;
 				data12.top10[i].used=0;
 			}
 		}
@@ -448,7 +533,7 @@ int convertdb(FILE *db)
 	} 
 
 	/* version 1.1-1.2 database format */
-	if (data.version==2 || converted==1) {
+	if (data->version==2 || converted==1) {
 
 		printf("Converting to db v3...\n");
 
@@ -463,86 +548,86 @@ int convertdb(FILE *db)
 		}
 
 		/* set basic values */
-		data.version=3;	
-		strncpy(data.interface, data12.interface, 32);
-		strncpy(data.nick, data12.nick, 32);
-		data.active=data12.active;
-		data.totalrx=data12.totalrx;
-		data.totaltx=data12.totaltx;
-		data.currx=data12.currx;
-		data.curtx=data12.curtx;
-		data.totalrxk=data12.totalrxk;
-		data.totaltxk=data12.totaltxk;
-		data.lastupdated=data12.lastupdated;
-		data.created=data12.created;
-		data.btime=data12.btime;
+		data->version=3;	
+		strncpy(data->interface, data12.interface, 32);
+		strncpy(data->nick, data12.nick, 32);
+		data->active=data12.active;
+		data->totalrx=data12.totalrx;
+		data->totaltx=data12.totaltx;
+		data->currx=data12.currx;
+		data->curtx=data12.curtx;
+		data->totalrxk=data12.totalrxk;
+		data->totaltxk=data12.totaltxk;
+		data->lastupdated=data12.lastupdated;
+		data->created=data12.created;
+		data->btime=data12.btime;
 
 		/* days */
 		for (i=0; i<=29; i++) {
 			if (data12.day[i].used) {
-				data.day[i].rx=data12.day[i].rx;
-				data.day[i].tx=data12.day[i].tx;
-				data.day[i].rxk=data.day[i].txk=0;
-				data.day[i].date=data12.day[i].date;
-				data.day[i].used=1;
+				data->day[i].rx=data12.day[i].rx;
+				data->day[i].tx=data12.day[i].tx;
+				data->day[i].rxk=data->day[i].txk=0;
+				data->day[i].date=data12.day[i].date;
+				data->day[i].used=1;
 			} else {
-				data.day[i].rx=data.day[i].tx=0;
-				data.day[i].rxk=data.day[i].txk=0;
-				data.day[i].used=0;
+				data->day[i].rx=data->day[i].tx=0;
+				data->day[i].rxk=data->day[i].txk=0;
+				data->day[i].used=0;
 			}			
 		}
 
 		/* months */
 		for (i=0; i<=11; i++) {
 			if (data12.month[i].used) {
-				data.month[i].rx=data12.month[i].rx;
-				data.month[i].tx=data12.month[i].tx;
-				data.month[i].rxk=data.month[i].txk=0;
-				data.month[i].month=data12.month[i].month;
-				data.month[i].used=1;
+				data->month[i].rx=data12.month[i].rx;
+				data->month[i].tx=data12.month[i].tx;
+				data->month[i].rxk=data->month[i].txk=0;
+				data->month[i].month=data12.month[i].month;
+				data->month[i].used=1;
 			} else {
-				data.month[i].rx=data.month[i].tx=0;
-				data.month[i].rxk=data.month[i].txk=0;
-				data.month[i].used=0;
+				data->month[i].rx=data->month[i].tx=0;
+				data->month[i].rxk=data->month[i].txk=0;
+				data->month[i].used=0;
 			}			
 		}
 
 		/* top10 */
 		for (i=0;i<=9;i++) {
 			if (data12.top10[i].used) {
-				data.top10[i].rx=data12.top10[i].rx;
-				data.top10[i].tx=data12.top10[i].tx;
-				data.top10[i].rxk=data.top10[i].txk=0;
-				data.top10[i].date=data12.top10[i].date;
-				data.top10[i].used=1;
+				data->top10[i].rx=data12.top10[i].rx;
+				data->top10[i].tx=data12.top10[i].tx;
+				data->top10[i].rxk=data->top10[i].txk=0;
+				data->top10[i].date=data12.top10[i].date;
+				data->top10[i].used=1;
 			} else {
-				data.top10[i].rx=data.top10[i].tx=0;
-				data.top10[i].rxk=data.top10[i].txk=0;
-				data.top10[i].date=0;
-				data.top10[i].used=0;
+				data->top10[i].rx=data->top10[i].tx=0;
+				data->top10[i].rxk=data->top10[i].txk=0;
+				data->top10[i].date=0;
+				data->top10[i].used=0;
 			}
 		}
 
 		/* hours */
 		for (i=0;i<=23;i++) {
-			data.hour[i].rx=0;
-			data.hour[i].tx=0;
-			data.hour[i].date=0;
+			data->hour[i].rx=0;
+			data->hour[i].tx=0;
+			data->hour[i].date=0;
 		}
 
 	}
 
 	/* corrupted or unknown version handling */
-	if (data.version==0) {
+	if (data->version==0) {
 		snprintf(errorstring, 512, "Unable to convert corrupted database.");
 		printe(PT_Error);
 		return 0;
-	} else if (data.version>DBVERSION) {
-		snprintf(errorstring, 512, "Unable to downgrade database from version \"%d\".", data.version);
+	} else if (data->version>DBVERSION) {
+		snprintf(errorstring, 512, "Unable to downgrade database from version \"%d\".", data->version);
 		printe(PT_Error);
 		return 0;	
-	} else if (data.version!=DBVERSION) {
-		snprintf(errorstring, 512, "Unable to convert database version \"%d\".", data.version);
+	} else if (data->version!=DBVERSION) {
+		snprintf(errorstring, 512, "Unable to convert database version \"%d\".", data->version);
 		printe(PT_Error);
 		return 0;
 	}
@@ -623,9 +708,13 @@ int removedb(const char *iface, const char *dirname)
 {
 	char file[512];
 
-	/* remove backup first */
+	/* remove backup, journal and sampled rates first */
 	snprintf(file, 512, "%s/.%s", dirname, iface);
 	unlink(file);
+	snprintf(file, 512, "%s/.%s.journal", dirname, iface);
+	unlink(file);
+	snprintf(file, 512, "%s/.%s.rates", dirname, iface);
+	unlink(file);
 
 	snprintf(file, 512, "%s/%s", dirname, iface);
 	if (unlink(file)!=0) {
@@ -636,92 +725,92 @@ int removedb(const char *iface, const char *dirname)
 	return 1;
 }
 
-void cleanhours(void)
+void cleanhours(DATA *data)
 {
 	int i, day, hour;
 	time_t current;
-	struct tm *d;
+	struct tm *d, tm;
 
 	current=time(NULL);
 
 	/* remove old data if needed */
 	for (i=0;i<=23;i++) {
-		if ( (data.hour[i].date!=0) && (data.hour[i].date<=(current-86400)) ) { /* 86400 = 24 hours = too old */
-			data.hour[i].rx=0;
-			data.hour[i].tx=0;
-			data.hour[i].date=0;
+		if ( (data->hour[i].date!=0) && (data->hour[i].date<=(current-86400)) ) { /* 86400 = 24 hours = too old */
+			data->hour[i].rx=0;
+			data->hour[i].tx=0;
+			data->hour[i].date=0;
 			if (debug) {
-				printf("db: Hour %d (%u) cleaned.\n", i, (unsigned int)data.hour[i].date);
+				printf("db: Hour %d (%u) cleaned.\n", i, (unsigned int)data->hour[i].date);
 			}
 		}
 	}
 
 	/* clean current if it's not from today to avoid incrementing old data */
-	d=localtime(&current);
+	d=localtime_r(&current, &tm);
 	day=d->tm_mday;
 	hour=d->tm_hour;
-	d=localtime(&data.hour[hour].date);
+	d=localtime_r(&data->hour[hour].date, &tm);
 	if (d->tm_mday!=day) {
-			data.hour[hour].rx=0;
-			data.hour[hour].tx=0;
+			data->hour[hour].rx=0;
+			data->hour[hour].tx=0;
 			if (debug) {
-				printf("db: Current hour %d (%u) cleaned.\n", hour, (unsigned int)data.hour[hour].date);
+				printf("db: Current hour %d (%u) cleaned.\n", hour, (unsigned int)data->hour[hour].date);
 			}
-			data.hour[hour].date=current;
+			data->hour[hour].date=current;
 	}
 }
 
-void rotatedays(void)
+void rotatedays(DATA *data)
 {
 	int i, j;
 	time_t current;
-	struct tm *d;
+	struct tm *d, tm;
 
 	for (i=29;i>=1;i--) {
-		data.day[i].rx=data.day[i-1].rx;
-		data.day[i].tx=data.day[i-1].tx;
-		data.day[i].rxk=data.day[i-1].rxk;
-		data.day[i].txk=data.day[i-1].txk;
-		data.day[i].date=data.day[i-1].date;
-		data.day[i].used=data.day[i-1].used;
+		data->day[i].rx=data->day[i-1].rx;
+		data->day[i].tx=data->day[i-1].tx;
+		data->day[i].rxk=data->day[i-1].rxk;
+		data->day[i].txk=data->day[i-1].txk;
+		data->day[i].date=data->day[i-1].date;
+		data->day[i].used=data->day[i-1].used;
 	}
 
 	current=time(NULL);
 
-	data.day[0].rx=0;
-	data.day[0].tx=0;
-	data.day[0].rxk=0;
-	data.day[0].txk=0;
-	data.day[0].date=current;
+	data->day[0].rx=0;
+	data->day[0].tx=0;
+	data->day[0].rxk=0;
+	data->day[0].txk=0;
+	data->day[0].date=current;
 
 	if (debug) {
-		d=localtime(&data.day[0].date);
+		d=localtime_r(&data->day[0].date, &tm);
 		printf("db: Days rotated. Current date: %d.%d.%d\n", d->tm_mday, d->tm_mon+1, d->tm_year+1900);
 	}
 
 	/* top10 update */
 	for (i=0;i<=9;i++) {
-		if ( data.day[1].rx+data.day[1].tx >= data.top10[i].rx+data.top10[i].tx ) {
+		if ( data->day[1].rx+data->day[1].tx >= data->top10[i].rx+data->top10[i].tx ) {
 
 			/* if MBs are same but kB smaller then continue searching */
-			if ( (data.day[1].rx+data.day[1].tx == data.top10[i].rx+data.top10[i].tx) && (data.day[1].rxk+data.day[1].txk <= data.top10[i].rxk+data.top10[i].txk) ) {
+			if ( (data->day[1].rx+data->day[1].tx == data->top10[i].rx+data->top10[i].tx) && (data->day[1].rxk+data->day[1].txk <= data->top10[i].rxk+data->top10[i].txk) ) {
 				continue;
 			}
 
 			for (j=9;j>=i+1;j--) {
-				data.top10[j].rx=data.top10[j-1].rx;
-				data.top10[j].tx=data.top10[j-1].tx;
-				data.top10[j].rxk=data.top10[j-1].rxk;
-				data.top10[j].txk=data.top10[j-1].txk;
-				data.top10[j].date=data.top10[j-1].date;
-				data.top10[j].used=data.top10[j-1].used;
+				data->top10[j].rx=data->top10[j-1].rx;
+				data->top10[j].tx=data->top10[j-1].tx;
+				data->top10[j].rxk=data->top10[j-1].rxk;
+				data->top10[j].txk=data->top10[j-1].txk;
+				data->top10[j].date=data->top10[j-1].date;
+				data->top10[j].used=data->top10[j-1].used;
 			}
-			data.top10[i].rx=data.day[1].rx;
-			data.top10[i].tx=data.day[1].tx;
-			data.top10[i].rxk=data.day[1].rxk;
-			data.top10[i].txk=data.day[1].txk;
-			data.top10[i].date=data.day[1].date;
-			data.top10[i].used=data.day[1].used;
+			data->top10[i].rx=data->day[1].rx;
+			data->top10[i].tx=data->day[1].tx;
+			data->top10[i].rxk=data->day[1].rxk;
+			data->top10[i].txk=data->day[1].txk;
+			data->top10[i].date=data->day[1].date;
+			data->top10[i].used=data->day[1].used;
 			break;
 		}
 	}
@@ -732,31 +821,236 @@ void rotatedays(void)
 
 }
 
-void rotatemonths(void)
+void rotatemonths(DATA *data)
 {
 	int i;
 	time_t current;
-	struct tm *d;
+	struct tm *d, tm;
 
 	for (i=11;i>=1;i--) {
-		data.month[i].rx=data.month[i-1].rx;
-		data.month[i].tx=data.month[i-1].tx;
-		data.month[i].rxk=data.month[i-1].rxk;
-		data.month[i].txk=data.month[i-1].txk;
-		data.month[i].month=data.month[i-1].month;
-		data.month[i].used=data.month[i-1].used;
+		data->month[i].rx=data->month[i-1].rx;
+		data->month[i].tx=data->month[i-1].tx;
+		data->month[i].rxk=data->month[i-1].rxk;
+		data->month[i].txk=data->month[i-1].txk;
+		data->month[i].month=data->month[i-1].month;
+		data->month[i].used=data->month[i-1].used;
 	}
 
 	current=time(NULL);
 
-	data.month[0].rx=0;
-	data.month[0].tx=0;
-	data.month[0].rxk=0;
-	data.month[0].txk=0;
-	data.month[0].month=current;
+	data->month[0].rx=0;
+	data->month[0].tx=0;
+	data->month[0].rxk=0;
+	data->month[0].txk=0;
+	data->month[0].month=current;
 
 	if (debug) {
-		d=localtime(&data.month[0].month);
+		d=localtime_r(&data->month[0].month, &tm);
 		printf("db: Months rotated. Current month: \"%d\".\n", d->tm_mon+1);
 	}
 }
+
+/* crc-32 (ieee), bitwise since only a few bytes are summed at a time */
+uint32_t dbcrc(uint32_t crc, const void *buf, int len)
+{
+	const unsigned char *p = buf;
+	int i;
+
+	crc = ~crc;
+	while (len-- > 0) {
+		crc ^= *p++;
+		for (i=0; i<8; i++) {
+			crc = (crc>>1) ^ (0xEDB88320U & (0U-(crc&1)));
+		}
+	}
+
+	return ~crc;
+}
+
+/* crc of the database file as it is on disk, 0 if it can't be read */
+int dbfilecrc(const char *iface, const char *dirname, uint32_t *crc)
+{
+	FILE *db;
+	DATA filedata;
+	char file[512];
+	int result = 0;
+
+	snprintf(file, 512, "%s/%s", dirname, iface);
+
+	if ((db=fopen(file,"r"))==NULL) {
+		return 0;
+	}
+
+	if (lockdb(fileno(db), 0) && fread(&filedata, sizeof(DATA), 1, db)==1) {
+		*crc = dbcrc(0, &filedata, sizeof(DATA));
+		result = 1;
+	}
+
+	fclose(db);
+	return result;
+}
+
+/* apply the saves in the journal that was started for the database with crc
+   base, stops at the first save that isn't complete. returns the saves applied */
+int readjournal(DATA *data, uint32_t base, const char *iface, const char *dirname)
+{
+	FILE *fp;
+	DATA work;
+	JOURNALHEAD head;
+	JOURNALREC rec;
+	unsigned char buffer[sizeof(DATA)];
+	char file[512];
+	uint32_t crc = 0;
+	int saves = 0;
+
+	snprintf(file, 512, "%s/.%s.journal", dirname, iface);
+
+	if ((fp=fopen(file, "r"))==NULL) {
+		return 0;
+	}
+
+	if (!lockdb(fileno(fp), 0)) {
+		fclose(fp);
+		return 0;
+	}
+
+	if (fread(&head, sizeof(JOURNALHEAD), 1, fp)!=1 || head.version!=JOURNALVERSION || head.base!=base) {
+		if (debug) {
+			printf("db: Journal \"%s\" not for this database.\n", file);
+		}
+		fclose(fp);
+		return 0;
+	}
+
+	memcpy(&work, data, sizeof(DATA));
+
+	while (fread(&rec, sizeof(JOURNALREC), 1, fp)==1) {
+
+		/* end of a save */
+		if (rec.length==0) {
+			if (rec.crc!=crc) {
+				break;
+			}
+			memcpy(data, &work, sizeof(DATA));
+			saves++;
+			crc = 0;
+			continue;
+		}
+
+		if (rec.offset+rec.length>sizeof(DATA) || fread(buffer, rec.length, 1, fp)!=1) {
+			break;
+		}
+		if (dbcrc(0, buffer, rec.length)!=rec.crc) {
+			break;
+		}
+
+		memcpy((unsigned char *)&work+rec.offset, buffer, rec.length);
+		crc = dbcrc(crc, &rec, sizeof(JOURNALREC));
+		crc = dbcrc(crc, buffer, rec.length);
+	}
+
+	fclose(fp);
+
+	if (debug) {
+		printf("db: %d saves applied from journal \"%s\".\n", saves, file);
+	}
+
+	return saves;
+}
+
+/* start an empty journal for the database with crc base */
+int newjournal(uint32_t base, const char *iface, const char *dirname)
+{
+	JOURNALHEAD head;
+	char file[512];
+	int fd;
+
+	snprintf(file, 512, "%s/.%s.journal", dirname, iface);
+
+	/* truncate only with the lock held, a reader may be in the old journal */
+	if ((fd=open(file, O_WRONLY|O_CREAT, 0666))==-1) {
+		return 0;
+	}
+
+	if (!lockdb(fd, 1)) {
+		close(fd);
+		return 0;
+	}
+
+	memset(&head, 0, sizeof(JOURNALHEAD));
+	head.version = JOURNALVERSION;
+	head.base = base;
+
+	if (ftruncate(fd, 0)!=0 || write(fd, &head, sizeof(JOURNALHEAD))!=sizeof(JOURNALHEAD) || fsync(fd)!=0) {
+		close(fd);
+		return 0;
+	}
+
+	close(fd);
+	return 1;
+}
+
+/* append the byte ranges where data differs from saved as one save,
+   returns the bytes added or -1 */
+int appendjournal(DATA *data, DATA *saved, const char *iface, const char *dirname)
+{
+	const unsigned char *now = (const unsigned char *)data, *prev = (const unsigned char *)saved;
+	unsigned char buffer[2*sizeof(DATA)+sizeof(JOURNALREC)];
+	char file[512];
+	JOURNALREC rec;
+	uint32_t crc = 0;
+	int i, start, end, len = 0, fd;
+
+	for (i=0; i<(int)sizeof(DATA); ) {
+		if (now[i]==prev[i]) {
+			i++;
+			continue;
+		}
+
+		/* a short run of equal bytes is cheaper to include than a new record */
+		start = end = i;
+		while (i<(int)sizeof(DATA) && i-end<=JOURNALGAP) {
+			if (now[i]!=prev[i]) {
+				end = i;
+			}
+			i++;
+		}
+
+		rec.offset = start;
+		rec.length = end-start+1;
+		rec.crc = dbcrc(0, now+start, rec.length);
+		memcpy(buffer+len, &rec, sizeof(JOURNALREC));
+		memcpy(buffer+len+sizeof(JOURNALREC), now+start, rec.length);
+		crc = dbcrc(crc, buffer+len, sizeof(JOURNALREC)+rec.length);
+		len += sizeof(JOURNALREC)+rec.length;
+	}
+
+	if (len==0) {
+		return 0;
+	}
+
+	rec.offset = rec.length = 0;
+	rec.crc = crc;
+	memcpy(buffer+len, &rec, sizeof(JOURNALREC));
+	len += sizeof(JOURNALREC);
+
+	snprintf(file, 512, "%s/.%s.journal", dirname, iface);
+
+	/* the journal has to exist already, it's started with the database */
+	if ((fd=open(file, O_WRONLY|O_APPEND))<0) {
+		return -1;
+	}
+
+	if (!lockdb(fd, 1)) {
+		close(fd);
+		return -1;
+	}
+
+	if (write(fd, buffer, len)!=len || fsync(fd)!=0) {
+		close(fd);
+		return -1;
+	}
+
+	close(fd);
+	return len;
+}
@@ -1,17 +1,25 @@
 #ifndef DBACCESS_H
 #define DBACCESS_H
 
-int readdb(const char *iface, const char *dirname);
-void initdb(void);
-int writedb(const char *iface, const char *dirname, int newdb);
+int readdb(DATA *data, const char *iface, const char *dirname);
+void initdb(DATA *data);
+int writedb(DATA *data, const char *iface, const char *dirname, int newdb);
+int writedbfile(DATA *data, const char *iface, const char *dirname, int newdb);
+int replacefile(const char *file, const char *tmp, const char *backup, const void *buf, int len);
+int syncdir(const char *dirname);
 int backupdb(const char *current, const char *backup);
-int convertdb(FILE *db);
+int convertdb(DATA *data, FILE *db);
 int lockdb(int fd, int dbwrite);
 int checkdb(const char *iface, const char *dirname);
 int removedb(const char *iface, const char *dirname);
-void cleanhours(void);
-void rotatedays(void);
-void rotatemonths(void);
+void cleanhours(DATA *data);
+void rotatedays(DATA *data);
+void rotatemonths(DATA *data);
+uint32_t dbcrc(uint32_t crc, const void *buf, int len);
+int dbfilecrc(const char *iface, const char *dirname, uint32_t *crc);
+int readjournal(DATA *data, uint32_t base, const char *iface, const char *dirname);
+int newjournal(uint32_t base, const char *iface, const char *dirname);
+int appendjournal(DATA *data, DATA *saved, const char *iface, const char *dirname);
 
 
 /* version 1.0 database format aka db v1 */
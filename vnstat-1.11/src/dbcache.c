@@ -2,22 +2,101 @@
 #include "ifinfo.h"
 #include "dbaccess.h"
 #include "dbcache.h"
+#include "rates.h"
 
-int cacheadd(const char *iface, int sync)
+/* index of the cache by interface name, open addressing with linear probing */
+static datanode **cacheindex = NULL;
+static int cacheindexsize = 0, cacheindexcount = 0;
+
+/* FNV-1a */
+static uint32_t cachehash(const char *iface)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*iface) {
+		hash ^= (unsigned char)*iface++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/* slot holding iface, or the empty slot where it would go */
+static int cacheslot(const char *iface)
 {
-	datanode *p, *n;
+	int i = cachehash(iface) & (cacheindexsize-1);
 
-	p = dataptr;
+	while (cacheindex[i] != NULL && strcmp(cacheindex[i]->data.interface, iface)!=0) {
+		i = (i+1) & (cacheindexsize-1);
+	}
+
+	return i;
+}
+
+static int cacheindexgrow(void)
+{
+	datanode **old = cacheindex;
+	int i, oldsize = cacheindexsize;
+
+	cacheindexsize = oldsize ? oldsize*2 : CACHEINDEXMIN;
+	cacheindex = calloc(cacheindexsize, sizeof(datanode *));
+
+	if (cacheindex == NULL) {
+		cacheindex = old;
+		cacheindexsize = oldsize;
+		return 0;
+	}
+
+	for (i=0; i<oldsize; i++) {
+		if (old[i] != NULL) {
+			cacheindex[cacheslot(old[i]->data.interface)] = old[i];
+		}
+	}
+	free(old);
+
+	return 1;
+}
+
+/* link a new node to the head of the list and into the index */
+static int cacheinsert(datanode *n)
+{
+	if ((cacheindexcount+1)*4 > cacheindexsize*3) {
+		if (!cacheindexgrow()) {
+			return 0;
+		}
+	}
+	cacheindex[cacheslot(n->data.interface)] = n;
+	cacheindexcount++;
+
+	n->prev = NULL;
+	n->next = dataptr;
+	if (dataptr != NULL) {
+		dataptr->prev = n;
+	}
+	dataptr = n;
+
+	return 1;
+}
+
+datanode *cachefind(const char *iface)
+{
+	if (cacheindexsize == 0) {
+		return NULL;
+	}
+
+	return cacheindex[cacheslot(iface)];
+}
+
+int cacheadd(const char *iface, int sync)
+{
+	datanode *n;
 
 	/* skip if already in list */
-	while (p != NULL) {
-		if (strcmp(p->data.interface, iface)==0) {
-			if (debug) {
-				printf("cache: %s already cached\n", iface);
-			}
-			return 1;
+	if (cachefind(iface) != NULL) {
+		if (debug) {
+			printf("cache: %s already cached\n", iface);
 		}
-		p = p->next;
+		return 1;
 	}
 
 	/* add new node if not in list */
@@ -27,13 +106,18 @@ int cacheadd(const char *iface, int sync)
 		return 0;
 	}
 
-	n->next = dataptr;
-	dataptr = n;
 	strncpy(n->data.interface, iface, 32);
 	n->data.interface[31] = '\0';
 	n->data.active = 1;
 	n->filled = 0;
 	n->sync = sync;
+	n->rates = NULL;
+	n->journal = -1;
+
+	if (!cacheinsert(n)) {
+		free(n);
+		return 0;
+	}
 
 	if (debug) {
 		printf("cache: %s added\n", iface);
@@ -42,91 +126,45 @@ int cacheadd(const char *iface, int sync)
 	return 1;
 }
 
+/* returns the node that followed the removed one */
 datanode *cacheremove(const char *iface)
 {
-	datanode *p, *o;
+	datanode *p, *next;
+	int i, j, k;
 
-	p = dataptr;
-
-	if (p == NULL) {
+	if (cacheindexsize == 0 || (p=cacheindex[i=cacheslot(iface)]) == NULL) {
 		return NULL;
-	} else {
-
-		/* handle list head remove */
-		if (strcmp(p->data.interface, iface)==0) {
-			dataptr = p->next;
-			if (debug) {
-				printf("cache: h %s removed\n", iface);
-			}
-			free(p);
-			return dataptr;
-		}
-
-		o = p;
-		p = p->next;
-
-		/* handle other locations */
-		while (p != NULL) {
-
-			if (strcmp(p->data.interface, iface)==0) {
-				o->next = p->next;
-				if (debug) {
-					printf("cache: %s removed\n", iface);
-				}
-				free(p);
-				return o->next;
-			}
-
-			o = p;
-			p = p->next;
-		}
 	}
 
-	return NULL;
-}
-
-int cacheupdate(void)
-{
-	datanode *p, *n;
-
-	p = dataptr;
-
-	/* update if already in list */
-	while (p != NULL) {
-		if (strcmp(p->data.interface, data.interface)==0) {
-			if (memcpy(&p->data, &data, sizeof(p->data))!=NULL) {
-				p->filled = 1;
-			} else {
-				p->filled = 0;
-			}
-			if (debug) {
-				printf("cache: %s updated (%d)\n", p->data.interface, p->filled);
-			}
-			return p->filled;
+	/* close the gap, moving back entries that probed past the slot */
+	cacheindex[i] = NULL;
+	cacheindexcount--;
+	for (j=(i+1) & (cacheindexsize-1); cacheindex[j] != NULL; j=(j+1) & (cacheindexsize-1)) {
+		k = cachehash(cacheindex[j]->data.interface) & (cacheindexsize-1);
+		if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+			cacheindex[i] = cacheindex[j];
+			cacheindex[j] = NULL;
+			i = j;
 		}
-		p = p->next;
 	}
 
-	/* add new node if not in list */
-	n = malloc(sizeof(datanode));
-
-	if (n == NULL) {
-		return 0;
-	}
-
-	n->next = dataptr;
-	dataptr = n;
-	if (memcpy(&n->data, &data, sizeof(n->data))!=NULL) {
-		n->filled = 1;
+	next = p->next;
+	if (p->prev != NULL) {
+		p->prev->next = next;
 	} else {
-		n->filled = 0;
+		dataptr = next;
+	}
+	if (next != NULL) {
+		next->prev = p->prev;
 	}
 
 	if (debug) {
-		printf("cache: %s added and updated (%d)\n", p->data.interface, p->filled);
+		printf("cache: %s removed\n", iface);
 	}
+	ratetrackfree(p->rates);
+	free(p);
 
-	return n->filled;
+	return next;
 }
 
 void cacheshow(void)
@@ -185,18 +223,17 @@ void cachestatus(void)
 int cacheget(datanode *dn)
 {
 	if (dn->filled) {
-		memcpy(&data, &dn->data, sizeof(data));
 
 		/* do simple data validation */
-		if (data.version != DBVERSION ||
-			data.created == 0 ||
-			data.lastupdated == 0 ||
-			data.interface[0] == '\0' ||
-			data.active > 1 ||
-			data.active < 0) {
+		if (dn->data.version != DBVERSION ||
+			dn->data.created == 0 ||
+			dn->data.lastupdated == 0 ||
+			dn->data.interface[0] == '\0' ||
+			dn->data.active > 1 ||
+			dn->data.active < 0) {
 
 			if (debug)
-				printf("cache get: validation failed (%d/%u/%u/%d/%d)\n", data.version, (unsigned int)data.created, (unsigned int)data.lastupdated, data.interface[0], data.active);
+				printf("cache get: validation failed (%d/%u/%u/%d/%d)\n", dn->data.version, (unsigned int)dn->data.created, (unsigned int)dn->data.lastupdated, dn->data.interface[0], dn->data.active);
 
 			/* force reading of database file */
 			dn->filled = 0;
@@ -214,6 +251,11 @@ int cacheget(datanode *dn)
 void cacheflush(const char *dirname)
 {
 	datanode *f, *p = dataptr;
+	int saves = 0;
+
+	free(cacheindex);
+	cacheindex = NULL;
+	cacheindexsize = cacheindexcount = 0;
 
 	while (p != NULL) {
 		f = p;
@@ -221,14 +263,26 @@ void cacheflush(const char *dirname)
 
 		/* write data to file if needed */
 		if (f->filled && dirname!=NULL) {
-			memcpy(&data, &f->data, sizeof(data));
-			writedb(f->data.interface, dirname, 0);
+			writedbfile(&f->data, f->data.interface, dirname, 0);
+			saves++;
 		}
 
+		/* the unfinished minute is kept too */
+		if (f->rates!=NULL && dirname!=NULL) {
+			rateminute(f->rates);
+			writerates(&f->rates->rates, f->data.interface, dirname);
+		}
+
+		ratetrackfree(f->rates);
 		free(f);
 	}
 
 	dataptr = NULL;
+
+	/* one directory sync for all renames */
+	if (saves) {
+		syncdir(dirname);
+	}
 }
 
 int cachecount(void)
@@ -294,23 +348,7 @@ uint32_t dbcheck(uint32_t dbhash, int *forcesave)
 					offset += (int)strlen(interface)+1;
 				}
 
-				if (p->data.active==1 && found==0) {
-					p->data.active = 0;
-					p->data.currx = p->data.curtx = 0;
-					if (cfg.savestatus) {
-						*forcesave = 1;
-					}
-					snprintf(errorstring, 512, "Interface \"%s\" disabled.", p->data.interface);
-					printe(PT_Info);
-				} else if (p->data.active==0 && found==1) {
-					p->data.active = 1;
-					p->data.currx = p->data.curtx = 0;
-					if (cfg.savestatus) {
-						*forcesave = 1;
-					}
-					snprintf(errorstring, 512, "Interface \"%s\" enabled.", p->data.interface);
-					printe(PT_Info);
-				}
+				cachesetactive(p, found, forcesave);
 			}
 			p = p->next;
 		}
@@ -321,6 +359,109 @@ uint32_t dbcheck(uint32_t dbhash, int *forcesave)
 	return newhash;
 }
 
+/* apply link notifications to the cached interfaces */
+void cachelinkevents(const LINKEVENT *ev, int count, int *forcesave)
+{
+	datanode *p;
+	int i;
+
+	for (i=0; i<count; i++) {
+
+		if (debug) {
+			printf("link event: %s %s\n", ev[i].name, ev[i].exists ? "exists" : "removed");
+		}
+
+		if ((p=cachefind(ev[i].name))!=NULL && p->filled) {
+			cachesetactive(p, ev[i].exists, forcesave);
+		}
+	}
+}
+
+/* enable or disable a cached interface when its existence has changed */
+void cachesetactive(datanode *p, int found, int *forcesave)
+{
+	if (p->data.active==1 && found==0) {
+		p->data.active = 0;
+		p->data.currx = p->data.curtx = 0;
+		if (cfg.savestatus) {
+			*forcesave = 1;
+		}
+		snprintf(errorstring, 512, "Interface \"%s\" disabled.", p->data.interface);
+		printe(PT_Info);
+	} else if (p->data.active==0 && found==1) {
+		p->data.active = 1;
+		p->data.currx = p->data.curtx = 0;
+		if (cfg.savestatus) {
+			*forcesave = 1;
+		}
+		snprintf(errorstring, 512, "Interface \"%s\" enabled.", p->data.interface);
+		printe(PT_Info);
+	}
+}
+
+/* take one rate sample of the cached interfaces from ifsnap, ms is monotonic time */
+void cachesample(uint64_t ms, time_t current, const char *dirname)
+{
+	IFSNAPENTRY *e;
+	datanode *p;
+
+	for (p=dataptr; p!=NULL; p=p->next) {
+
+		if (!p->filled) {
+			continue;
+		}
+
+		if (p->rates==NULL && (p->rates=ratetrackinit(p->data.interface, dirname))==NULL) {
+			continue;
+		}
+
+		/* start over when the interface comes back */
+		if (!p->data.active || (e=ifsnapfind(p->data.interface))==NULL) {
+			p->rates->primed = 0;
+			continue;
+		}
+
+		ratesample(p->rates, p->data.interface, e->rx, e->tx, ms, current);
+	}
+}
+
+/* save the node, as a journal entry of the changes when possible and
+   as a full database write when the journal has grown too long. the
+   directory isn't synced, see syncdir() */
+int cachesave(datanode *dn, const char *dirname)
+{
+	uint32_t crc;
+	int len;
+
+	/* the journal is only valid as long as nothing else rewrote the database */
+	if (dn->journal>=0 && dn->journal<JOURNALMAX && dbfilecrc(dn->data.interface, dirname, &crc) && crc==dn->base) {
+		if ((len=appendjournal(&dn->data, &dn->saved, dn->data.interface, dirname))>=0) {
+			dn->journal += len;
+			memcpy(&dn->saved, &dn->data, sizeof(DATA));
+			if (debug) {
+				printf("cache: %s journal +%d (%d)\n", dn->data.interface, len, dn->journal);
+			}
+			return 1;
+		}
+	}
+
+	if (!writedbfile(&dn->data, dn->data.interface, dirname, 0)) {
+		dn->journal = -1;
+		return 0;
+	}
+
+	/* writedbfile sets lastupdated, the crc has to be of what was written */
+	memcpy(&dn->saved, &dn->data, sizeof(DATA));
+	dn->base = dbcrc(0, &dn->saved, sizeof(DATA));
+	dn->journal = newjournal(dn->base, dn->data.interface, dirname) ? 0 : -1;
+
+	if (debug) {
+		printf("cache: %s written, journal %s\n", dn->data.interface, dn->journal ? "not started" : "started");
+	}
+
+	return 1;
+}
+
 uint32_t simplehash(const char *data, int len)
 {
 	uint32_t hash = len;
@@ -5,12 +5,19 @@ typedef struct datanode {
 	DATA data;
 	short filled;
 	short sync;
-	struct datanode *next;
+	RATETRACK *rates;       /* NULL unless rates are sampled */
+	DATA saved;             /* data as of the last save */
+	uint32_t base;          /* crc of the database file the journal is for */
+	int journal;            /* journal bytes, -1 when a full write is needed */
+	struct datanode *next, *prev;
 } datanode;
 
+/* the cache index starts with this many slots and doubles when 3/4 full */
+#define CACHEINDEXMIN 16
+
 int cacheadd(const char *iface, int sync);
 datanode *cacheremove(const char *iface);
-int cacheupdate(void);
+datanode *cachefind(const char *iface);
 void cacheshow(void);
 void cachestatus(void);
 int cacheget(datanode *dn);
@@ -18,6 +25,10 @@ void cacheflush(const char *dirname);
 int cachecount(void);
 int cacheactivecount(void);
 uint32_t dbcheck(uint32_t dbhash, int *forcesave);
+void cachelinkevents(const LINKEVENT *ev, int count, int *forcesave);
+void cachesetactive(datanode *p, int found, int *forcesave);
+void cachesample(uint64_t ms, time_t current, const char *dirname);
+int cachesave(datanode *dn, const char *dirname);
 uint32_t simplehash(const char *data, int len);
 
 /* global variables */
@@ -26,7 +26,7 @@ int mergedb(char iface[], char dirname[])
 		if (debug)
 			printf("merging %s:\n", ifaceptr);
 
-		if (readdb(ifaceptr, dirname)!=0) {
+		if (readdb(&data, ifaceptr, dirname)!=0) {
 			printf("Merge \"%s\" failed.\n", mergedata.interface);
 			return 0;
 		}
@@ -133,7 +133,7 @@ int mergewith(DATA *dat)
 	}
 
 	/* clean hours from loaded db */
-	cleanhours();
+	cleanhours(&data);
 
 	/* merge hours */
 	for (i=0;i<=23;i++) {
@@ -1,5 +1,7 @@
 #include "common.h"
 #include "misc.h"
+#include "dbaccess.h"
+#include "rates.h"
 #include "dbshow.h"
 
 void showdb(int qmode)
@@ -1007,6 +1009,59 @@ void showoneline(void)
 	printf("%s\n", getvalue(data.totalrx+data.totaltx, data.totalrxk+data.totaltxk, 1, 1));
 }
 
+void showrates(const char *dirname, int minutes)
+{
+	RATES rates;
+	MINUTERATE *m;
+	struct tm *d;
+	char timetemp[16];
+	int i, s, shown=0;
+	time_t since;
+
+	if (!readrates(&rates, data.interface, dirname)) {
+		printf(" %s: No sampled rates available, see SampleInterval in vnstat.conf.\n", data.interface);
+		return;
+	}
+
+	if (minutes<1 || minutes>RATEMINUTES) {
+		minutes=RATEMINUTES;
+	}
+
+	printf("\n");
+	if (strcmp(data.interface, data.nick)==0) {
+		printf(" %s  /  rates per minute (%d ms samples)\n\n", data.interface, rates.sampleinterval);
+	} else {
+		printf(" %s (%s)  /  rates per minute (%d ms samples)\n\n", data.nick, data.interface, rates.sampleinterval);
+	}
+
+	printf("     minute      rx peak        rx p95     |     tx peak        tx p95\n");
+	printf("   ---------------------------------------+-------------------------------\n");
+
+	/* minutes without samples have no slot, so the whole ring is looked
+	   through for the ones in the requested time, oldest first */
+	since=time(NULL)-(time_t)minutes*60;
+	for (i=RATEMINUTES;i>=1;i--) {
+		s=(rates.next-i+RATEMINUTES)%RATEMINUTES;
+		m=&rates.minute[s];
+		if (m->minute==0 || m->minute<since) {
+			continue;
+		}
+
+		d=localtime(&m->minute);
+		strftime(timetemp, 16, "%H:%M", d);
+		printf("      %s ", timetemp);
+		printf("%s ", getrate(0, (m->rxpeak+512)/1024, 1, 14));
+		printf("%s  |", getrate(0, (m->rxp95+512)/1024, 1, 14));
+		printf("%s ", getrate(0, (m->txpeak+512)/1024, 1, 14));
+		printf("%s\n", getrate(0, (m->txp95+512)/1024, 1, 14));
+		shown++;
+	}
+
+	if (!shown) {
+		printf("      no data available\n");
+	}
+}
+
 void dumpdb(void)
 {
 	int i;
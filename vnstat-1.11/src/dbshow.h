@@ -11,6 +11,7 @@ void showweeks(void);
 void showhours(void);
 void showoneline(void);
 void dumpdb(void);
+void showrates(const char *dirname, int minutes);
 void showbar(uint64_t rx, int rxk, uint64_t tx, int txk, uint64_t max, int len);
 void indent(int i);
 
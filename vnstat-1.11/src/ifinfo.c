@@ -45,11 +45,9 @@ int getifinfo(const char *iface)
 int getiflist(char **ifacelist)
 {
 #if defined(__linux__)
-	char interface[32];
-	FILE *fp;
 	DIR *dp;
 	struct dirent *di;
-	char procline[512], temp[64];
+	int i;
 #elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) || defined(__FreeBSD_kernel__)
 	struct ifaddrs *ifap, *ifa;
 #endif
@@ -59,20 +57,15 @@ int getiflist(char **ifacelist)
 	*ifacelist[0] = '\0';
 
 #if defined(__linux__)
-	if ((fp=fopen(PROCNETDEV, "r"))!=NULL) {
+	if ((ifsnap.shared && ifsnap.valid) || ifsnapread()) {
 
 		/* make list of interfaces */
-		while (fgets(procline, 512, fp)!=NULL) {
-			sscanf(procline, "%64s", temp);
-			if (isdigit(temp[(strlen(temp)-1)]) || temp[(strlen(temp)-1)]==':') {
-				sscanf(temp, "%32[^':']s", interface);
-				*ifacelist = realloc(*ifacelist, ( ( strlen(*ifacelist) + strlen(interface) + 2 ) * sizeof(char)) );
-				strncat(*ifacelist, interface, strlen(interface));
-				strcat(*ifacelist, " ");
-			}
+		for (i=0; i<ifsnap.count; i++) {
+			*ifacelist = realloc(*ifacelist, ( ( strlen(*ifacelist) + strlen(ifsnap.entry[i].name) + 2 ) * sizeof(char)) );
+			strncat(*ifacelist, ifsnap.entry[i].name, strlen(ifsnap.entry[i].name));
+			strcat(*ifacelist, " ");
 		}
 
-		fclose(fp);
 		return 1;
 
 	} else {
@@ -116,10 +109,84 @@ int getiflist(char **ifacelist)
 }
 
 int readproc(const char *iface)
+{
+	IFSNAPENTRY *e;
+
+	/* the daemon reads the table once per poll and its update threads only look
+	   it up, a failed read leaves them to /sys. other callers read it for every lookup */
+	if (ifsnap.shared) {
+		if (!ifsnap.valid) {
+			return 0;
+		}
+	} else if (!ifsnapread()) {
+		return 0;
+	}
+
+	if ((e=ifsnapfind(iface))==NULL) {
+		if (debug)
+			printf("Requested interface \"%s\" not found.\n", iface);
+		return 0;
+	}
+
+	strncpy(ifinfo.name, iface, 32);
+	ifinfo.rx = e->rx;
+	ifinfo.tx = e->tx;
+
+	/* daemon doesn't need packet data */
+	if (!noexit) {
+		ifinfo.rxp = e->rxp;
+		ifinfo.txp = e->txp;
+	}
+
+	ifinfo.filled = 1;
+
+	return 1;
+}
+
+/* next free entry of ifsnap, NULL if the table can't grow */
+static IFSNAPENTRY *ifsnapnew(void)
+{
+	IFSNAPENTRY *e;
+
+	if (ifsnap.count==ifsnap.size) {
+		e = realloc(ifsnap.entry, (ifsnap.size+16) * sizeof(IFSNAPENTRY));
+		if (e==NULL) {
+			return NULL;
+		}
+		ifsnap.entry = e;
+		ifsnap.size += 16;
+	}
+
+	e = &ifsnap.entry[ifsnap.count];
+	memset(e, 0, sizeof(IFSNAPENTRY));
+
+	return e;
+}
+
+/* read the counters of all interfaces into ifsnap, from netlink if
+   possible and from /proc/net/dev if not */
+int ifsnapread(void)
+{
+#if defined(__linux__)
+	if (ifsnapnetlink()) {
+		return 1;
+	}
+	if (debug)
+		printf("Failed to use netlink as source.\n");
+#endif
+
+	return ifsnapproc();
+}
+
+int ifsnapproc(void)
 {
 	FILE *fp;
-	char temp[4][64], procline[512], *proclineptr, ifaceid[33];
-	int check;
+	char procline[512], *name, *p;
+	IFSNAPENTRY *e;
+	int i;
+
+	ifsnap.valid = 0;
+	ifsnap.count = 0;
 
 	if ((fp=fopen(PROCNETDEV, "r"))==NULL) {
 		if (debug)
@@ -127,48 +194,239 @@ int readproc(const char *iface)
 		return 0;
 	}
 
-	strncpy(ifaceid, iface, 32);
-	strcat(ifaceid, ":");
-
-	check = 0;
 	while (fgets(procline, 512, fp)!=NULL) {
-		sscanf(procline, "%512s", temp[0]);
-		if (strncmp(ifaceid, temp[0], strlen(ifaceid))==0) {
-			/* if (debug)
-				printf("\n%s\n", procline); */
-			check = 1;
+
+		/* interface lines are "name: counters", the header lines have no ':' */
+		if ((p=strchr(procline, ':'))==NULL) {
+			continue;
+		}
+		*p++ = '\0';
+		for (name=procline; isspace(*name); name++);
+
+		if ((e=ifsnapnew())==NULL) {
 			break;
 		}
+		strncpy(e->name, name, 32);
+		e->name[31] = '\0';
+
+		/* rx bytes, packets, 6 other rx fields, tx bytes, packets */
+		e->rx = strtoull(p, &p, 10);
+		e->rxp = strtoull(p, &p, 10);
+		for (i=0; i<6; i++) {
+			strtoull(p, &p, 10);
+		}
+		e->tx = strtoull(p, &p, 10);
+		e->txp = strtoull(p, &p, 10);
+
+		ifsnap.count++;
 	}
 	fclose(fp);
 
-	if (check==0) {
-		if (debug)
-			printf("Requested interface \"%s\" not found.\n", iface);
+	ifsnap.valid = 1;
+
+	return 1;
+}
+
+#if defined(__linux__)
+/* read the counters of all interfaces into ifsnap with one RTM_GETLINK
+   dump, 64 bit counters where the kernel has them */
+int ifsnapnetlink(void)
+{
+	struct {
+		struct nlmsghdr nh;
+		struct ifinfomsg ifi;
+	} req;
+	static char buf[32768];
+	struct nlmsghdr *nh;
+	struct ifinfomsg *ifi;
+	struct rtattr *rta;
+	struct rtnl_link_stats64 s64;
+	struct rtnl_link_stats s32;
+	IFSNAPENTRY *e;
+	int fd, len, attrlen, has64, done = 0;
+
+	if ((fd=socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE))<0) {
 		return 0;
-	} else {
+	}
 
-		strncpy(ifinfo.name, iface, 32);
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+	req.nh.nlmsg_type = RTM_GETLINK;
+	req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.nh.nlmsg_seq = 1;
+	req.ifi.ifi_family = AF_UNSPEC;
 
-		/* get rx and tx from procline */
-		proclineptr = strchr(procline, ':');
-		sscanf(proclineptr+1, "%64s %64s %*s %*s %*s %*s %*s %*s %64s %64s", temp[0], temp[1], temp[2], temp[3]);
+	if (send(fd, &req, req.nh.nlmsg_len, 0)<0) {
+		close(fd);
+		return 0;
+	}
 
-		ifinfo.rx = strtoull(temp[0], (char **)NULL, 0);
-		ifinfo.tx = strtoull(temp[2], (char **)NULL, 0);
+	ifsnap.valid = 0;
+	ifsnap.count = 0;
 
-		/* daemon doesn't need packet data */
-		if (!noexit) {
-			ifinfo.rxp = strtoull(temp[1], (char **)NULL, 0);
-			ifinfo.txp = strtoull(temp[3], (char **)NULL, 0);
+	while (!done) {
+		len = recv(fd, buf, sizeof(buf), 0);
+		if (len<0 && errno==EINTR) {
+			continue;
+		}
+		if (len<=0) {
+			close(fd);
+			return 0;
 		}
 
-		ifinfo.filled = 1;
+		for (nh=(struct nlmsghdr *)buf; NLMSG_OK(nh, (unsigned int)len); nh=NLMSG_NEXT(nh, len)) {
+			if (nh->nlmsg_type==NLMSG_DONE) {
+				done = 1;
+				break;
+			}
+			if (nh->nlmsg_type==NLMSG_ERROR) {
+				close(fd);
+				return 0;
+			}
+			if (nh->nlmsg_type!=RTM_NEWLINK || (e=ifsnapnew())==NULL) {
+				continue;
+			}
+
+			ifi = NLMSG_DATA(nh);
+			attrlen = IFLA_PAYLOAD(nh);
+			e->index = ifi->ifi_index;
+			has64 = 0;
+			for (rta=IFLA_RTA(ifi); RTA_OK(rta, attrlen); rta=RTA_NEXT(rta, attrlen)) {
+				if (rta->rta_type==IFLA_IFNAME) {
+					strncpy(e->name, RTA_DATA(rta), 32);
+					e->name[31] = '\0';
+				} else if (rta->rta_type==IFLA_STATS64 && RTA_PAYLOAD(rta)>=sizeof(s64)) {
+					/* attribute data is only 4 byte aligned */
+					memcpy(&s64, RTA_DATA(rta), sizeof(s64));
+					e->rx = s64.rx_bytes;
+					e->tx = s64.tx_bytes;
+					e->rxp = s64.rx_packets;
+					e->txp = s64.tx_packets;
+					has64 = 1;
+				} else if (rta->rta_type==IFLA_STATS && !has64 && RTA_PAYLOAD(rta)>=sizeof(s32)) {
+					memcpy(&s32, RTA_DATA(rta), sizeof(s32));
+					e->rx = s32.rx_bytes;
+					e->tx = s32.tx_bytes;
+					e->rxp = s32.rx_packets;
+					e->txp = s32.tx_packets;
+				}
+			}
+
+			if (e->name[0]!='\0') {
+				ifsnap.count++;
+			}
+		}
 	}
+	close(fd);
+
+	ifsnap.valid = 1;
 
 	return 1;
 }
 
+/* socket for link add, remove and change notifications, -1 if not available */
+int linkeventopen(void)
+{
+	struct sockaddr_nl sa;
+	int fd;
+
+	if ((fd=socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE))<0) {
+		return -1;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+	sa.nl_groups = RTMGRP_LINK;
+
+	if (bind(fd, (struct sockaddr *)&sa, sizeof(sa))<0 || fcntl(fd, F_SETFL, O_NONBLOCK)<0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* read all link events that are queued into ev, returns the number of events,
+   -1 if events were lost and the interface list has to be checked in full */
+int linkeventread(int fd, LINKEVENT *ev)
+{
+	static char buf[8192];
+	struct nlmsghdr *nh;
+	struct ifinfomsg *ifi;
+	struct rtattr *rta;
+	char *name;
+	int len, attrlen, i, count = 0, lost = 0;
+
+	while ((len=recv(fd, buf, sizeof(buf), 0))!=0) {
+		if (len<0) {
+			/* the socket buffer overflowed, something was missed */
+			if (errno==ENOBUFS) {
+				lost = 1;
+				continue;
+			}
+			break;
+		}
+		for (nh=(struct nlmsghdr *)buf; NLMSG_OK(nh, (unsigned int)len); nh=NLMSG_NEXT(nh, len)) {
+			if (nh->nlmsg_type!=RTM_NEWLINK && nh->nlmsg_type!=RTM_DELLINK) {
+				continue;
+			}
+
+			ifi = NLMSG_DATA(nh);
+			attrlen = IFLA_PAYLOAD(nh);
+			name = NULL;
+			for (rta=IFLA_RTA(ifi); RTA_OK(rta, attrlen); rta=RTA_NEXT(rta, attrlen)) {
+				if (rta->rta_type==IFLA_IFNAME) {
+					name = RTA_DATA(rta);
+				}
+			}
+			if (name==NULL) {
+				continue;
+			}
+
+			/* a renamed link keeps its index, its old name is gone */
+			if (nh->nlmsg_type==RTM_NEWLINK) {
+				for (i=0; i<ifsnap.count; i++) {
+					if (ifsnap.entry[i].index==ifi->ifi_index && strcmp(ifsnap.entry[i].name, name)!=0) {
+						if (count<LINKEVENTS) {
+							strncpy(ev[count].name, ifsnap.entry[i].name, 32);
+							ev[count].exists = 0;
+						}
+						count++;
+						break;
+					}
+				}
+			}
+
+			if (count<LINKEVENTS) {
+				strncpy(ev[count].name, name, 32);
+				ev[count].name[31] = '\0';
+				ev[count].exists = nh->nlmsg_type==RTM_NEWLINK;
+			}
+			count++;
+		}
+	}
+
+	if (lost || count>LINKEVENTS) {
+		return -1;
+	}
+
+	return count;
+}
+#endif
+
+IFSNAPENTRY *ifsnapfind(const char *iface)
+{
+	int i;
+
+	for (i=0; i<ifsnap.count; i++) {
+		if (strcmp(ifsnap.entry[i].name, iface)==0) {
+			return &ifsnap.entry[i];
+		}
+	}
+
+	return NULL;
+}
+
 int readsysclassnet(const char *iface)
 {
 	FILE *fp;
@@ -250,18 +508,18 @@ int readsysclassnet(const char *iface)
 	return 1;
 }
 
-void parseifinfo(int newdb)
+void parseifinfo(DATA *data, int newdb)
 {
 	uint64_t rxchange=0, txchange=0, btime, cc;   /* rxchange = rx change in MB */
 	uint64_t krxchange=0, ktxchange=0, maxtransfer;   /* krxchange = rx change in kB */
 	time_t current, interval;
-	struct tm *d;
+	struct tm *d, tm;
 	int day, month, year, hour, min, shift, maxbw;
 	int rxkchange=0, txkchange=0;			          /* changes in the kB counters */
 
 	ifinfo.rxp = ifinfo.txp = 0;
 	current=time(NULL);
-	interval=current-data.lastupdated;
+	interval=current-data->lastupdated;
 	btime=getbtime();
 
 	/* count traffic only if previous update wasn't too long ago */
@@ -269,22 +527,22 @@ void parseifinfo(int newdb)
 
 		/* btime in /proc/stat seems to vary 1 second so we use btime-BVAR just to be safe */
 		/* the variation is also slightly different between various kernels... */
-		if (data.btime < (btime-cfg.bvar)) {
-			data.currx=0;
-			data.curtx=0;
+		if (data->btime < (btime-cfg.bvar)) {
+			data->currx=0;
+			data->curtx=0;
 			if (debug)
 				printf("System has been booted.\n");
 		}
 
 		/* process rx & tx */
 		if (newdb!=1) {
-			cc = countercalc(data.currx, ifinfo.rx);
+			cc = countercalc(data->currx, ifinfo.rx);
 			rxchange = cc/1048576;      /* 1024/1024 */
 			rxkchange = (cc/1024)%1024;
 			krxchange = cc/1024;
 			ifinfo.rxp = cc%1024;
 
-			cc = countercalc(data.curtx, ifinfo.tx);
+			cc = countercalc(data->curtx, ifinfo.tx);
 			txchange = cc/1048576;      /* 1024/1024 */
 			txkchange = (cc/1024)%1024;
 			ktxchange = cc/1024;
@@ -292,7 +550,7 @@ void parseifinfo(int newdb)
 		}
 
 		/* get bandwidth limit for current interface */
-		maxbw = ibwget(data.interface);
+		maxbw = ibwget(data->interface);
 
 		if (maxbw > 0) {
 
@@ -305,7 +563,7 @@ void parseifinfo(int newdb)
 
 			/* sync counters if traffic is greater than set maximum */
 			if ( (rxchange > maxtransfer) || (txchange > maxtransfer) ) {
-				snprintf(errorstring, 512, "Traffic rate for \"%s\" higher than set maximum %d Mbit (%"PRIu64"->%"PRIu64", r%"PRIu64" t%"PRIu64"), syncing.", data.interface, maxbw, (uint64_t)interval, maxtransfer, rxchange, txchange);
+				snprintf(errorstring, 512, "Traffic rate for \"%s\" higher than set maximum %d Mbit (%"PRIu64"->%"PRIu64", r%"PRIu64" t%"PRIu64"), syncing.", data->interface, maxbw, (uint64_t)interval, maxtransfer, rxchange, txchange);
 				printe(PT_Info);
 				rxchange = krxchange = rxkchange = txchange = ktxchange = txkchange = 0;
 				ifinfo.rxp = ifinfo.txp = 0;
@@ -319,21 +577,21 @@ void parseifinfo(int newdb)
 
 
 	/* keep btime updated in case it drifts slowly */
-	data.btime = btime;
+	data->btime = btime;
 
-	data.currx = ifinfo.rx - ifinfo.rxp;
-	data.curtx = ifinfo.tx - ifinfo.txp;
-	addtraffic(&data.totalrx, &data.totalrxk, rxchange, rxkchange);
-	addtraffic(&data.totaltx, &data.totaltxk, txchange, txkchange);
+	data->currx = ifinfo.rx - ifinfo.rxp;
+	data->curtx = ifinfo.tx - ifinfo.txp;
+	addtraffic(&data->totalrx, &data->totalrxk, rxchange, rxkchange);
+	addtraffic(&data->totaltx, &data->totaltxk, txchange, txkchange);
 
 	/* update days and months */
-	addtraffic(&data.day[0].rx, &data.day[0].rxk, rxchange, rxkchange);
-	addtraffic(&data.day[0].tx, &data.day[0].txk, txchange, txkchange);
-	addtraffic(&data.month[0].rx, &data.month[0].rxk, rxchange, rxkchange);
-	addtraffic(&data.month[0].tx, &data.month[0].txk, txchange, txkchange);	
+	addtraffic(&data->day[0].rx, &data->day[0].rxk, rxchange, rxkchange);
+	addtraffic(&data->day[0].tx, &data->day[0].txk, txchange, txkchange);
+	addtraffic(&data->month[0].rx, &data->month[0].rxk, rxchange, rxkchange);
+	addtraffic(&data->month[0].tx, &data->month[0].txk, txchange, txkchange);	
 
 	/* fill some variables from current date & time */
-	d=localtime(&current);
+	d=localtime_r(&current, &tm);
 	day=d->tm_mday;
 	month=d->tm_mon;
 	year=d->tm_year;
@@ -343,8 +601,8 @@ void parseifinfo(int newdb)
 
 	/* add traffic to previous hour when update happens at X:00 */
 	/* and previous update was during previous hour */
-	d=localtime(&data.lastupdated);
-	if ((min==0) && (d->tm_hour!=hour) && ((current-data.lastupdated)<=3600)) {
+	d=localtime_r(&data->lastupdated, &tm);
+	if ((min==0) && (d->tm_hour!=hour) && ((current-data->lastupdated)<=3600)) {
 		hour--;
 		if (hour<0) {
 			hour=23;
@@ -352,27 +610,27 @@ void parseifinfo(int newdb)
 	}
 
 	/* clean and update hourly */
-	cleanhours();
-	data.hour[shift].date=current;   /* avoid shifting timestamp */
-	data.hour[hour].rx+=krxchange;
-	data.hour[hour].tx+=ktxchange;
+	cleanhours(data);
+	data->hour[shift].date=current;   /* avoid shifting timestamp */
+	data->hour[hour].rx+=krxchange;
+	data->hour[hour].tx+=ktxchange;
 
 	/* rotate days in database if needed */
-	d=localtime(&data.day[0].date);
+	d=localtime_r(&data->day[0].date, &tm);
 	if ((d->tm_mday!=day) || (d->tm_mon!=month) || (d->tm_year!=year)) {
 
 		/* make a new entry only if there's something to remember (configuration dependent) */
-		if ( (data.day[0].rx==0) && (data.day[0].tx==0) && (data.day[0].rxk==0) && (data.day[0].txk==0) && (cfg.traflessday==0) ) {
-			data.day[0].date=current;
+		if ( (data->day[0].rx==0) && (data->day[0].tx==0) && (data->day[0].rxk==0) && (data->day[0].txk==0) && (cfg.traflessday==0) ) {
+			data->day[0].date=current;
 		} else {
-			rotatedays();
+			rotatedays(data);
 		}
 	}
 
 	/* rotate months in database if needed */
-	d=localtime(&data.month[0].month);
+	d=localtime_r(&data->month[0].month, &tm);
 	if ((d->tm_mon!=month) && (day>=cfg.monthrotate)) {
-		rotatemonths();
+		rotatemonths(data);
 	}
 }
 
@@ -4,9 +4,17 @@
 int getifinfo(const char *iface);
 int getiflist(char **ifacelist);
 int readproc(const char *iface);
+int ifsnapread(void);
+int ifsnapproc(void);
+IFSNAPENTRY *ifsnapfind(const char *iface);
 int readsysclassnet(const char *iface);
-void parseifinfo(int newdb);
+void parseifinfo(DATA *data, int newdb);
 uint64_t countercalc(uint64_t a, uint64_t b);
+#if defined(__linux__)
+int ifsnapnetlink(void);
+int linkeventopen(void);
+int linkeventread(int fd, LINKEVENT *ev);
+#endif
 #if defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) || defined(__FreeBSD_kernel__)
 int readifaddrs(const char *iface);
 #endif
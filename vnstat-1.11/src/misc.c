@@ -395,3 +395,13 @@ char *getrateunit(int unit, int index)
 		return bunit[(unit*UNITCOUNT)+index];
 	}
 }
+
+/* milliseconds on a clock that isn't changed with the wall clock */
+uint64_t monotonicms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec*1000+ts.tv_nsec/1000000;
+}
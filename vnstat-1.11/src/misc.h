@@ -13,5 +13,6 @@ char *getrate(uint64_t mb, uint64_t kb, uint32_t interval, int len);
 uint64_t getscale(uint64_t kb);
 char *getunit(int index);
 char *getrateunit(int unit, int index);
+uint64_t monotonicms(void);
 
 #endif
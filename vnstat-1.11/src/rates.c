@@ -0,0 +1,168 @@
+#include "common.h"
+#include "ifinfo.h"
+#include "dbaccess.h"
+#include "cfg.h"
+#include "rates.h"
+
+int readrates(RATES *rates, const char *iface, const char *dirname)
+{
+	FILE *fp;
+	char file[512];
+	int result = 0;
+
+	snprintf(file, 512, "%s/.%s.rates", dirname, iface);
+
+	if ((fp=fopen(file, "r"))==NULL) {
+		return 0;
+	}
+
+	if (lockdb(fileno(fp), 0)) {
+		if (fread(rates, sizeof(RATES), 1, fp)==1 && rates->version==RATESVERSION) {
+			result = 1;
+		} else if (debug) {
+			printf("rates: \"%s\" not usable.\n", file);
+		}
+	}
+
+	fclose(fp);
+	return result;
+}
+
+/* the directory isn't synced, the daemon does that once per save */
+int writerates(RATES *rates, const char *iface, const char *dirname)
+{
+	char file[512], tmp[512];
+
+	if (snprintf(file, 512, "%s/.%s.rates", dirname, iface)>=512 ||
+		snprintf(tmp, 512, "%s/.%s.rates.tmp", dirname, iface)>=512 ||
+		replacefile(file, tmp, NULL, rates, sizeof(RATES))!=1) {
+		snprintf(errorstring, 512, "Unable to write rates of \"%s\" in \"%s\".", iface, dirname);
+		printe(PT_Error);
+		return 0;
+	}
+
+	if (debug) {
+		printf("rates: \"%s\" saved.\n", file);
+	}
+
+	return 1;
+}
+
+void initrates(RATES *rates, const char *iface)
+{
+	memset(rates, 0, sizeof(RATES));
+	rates->version = RATESVERSION;
+	strncpy(rates->interface, iface, 32);
+	rates->interface[31] = '\0';
+}
+
+/* sample buffers for one interface, the ring continues from its file */
+RATETRACK *ratetrackinit(const char *iface, const char *dirname)
+{
+	RATETRACK *t;
+
+	if ((t=calloc(1, sizeof(RATETRACK)))==NULL) {
+		return NULL;
+	}
+
+	/* room for twice the ticks of a minute, late ticks make the count vary */
+	t->size = 2*60000/cfg.sampleinterval;
+	t->rxsample = malloc(t->size*sizeof(uint32_t));
+	t->txsample = malloc(t->size*sizeof(uint32_t));
+
+	if (t->rxsample==NULL || t->txsample==NULL) {
+		ratetrackfree(t);
+		return NULL;
+	}
+
+	if (!readrates(&t->rates, iface, dirname) || strcmp(t->rates.interface, iface)!=0) {
+		initrates(&t->rates, iface);
+	}
+	t->rates.sampleinterval = cfg.sampleinterval;
+
+	return t;
+}
+
+void ratetrackfree(RATETRACK *t)
+{
+	if (t==NULL) {
+		return;
+	}
+
+	free(t->rxsample);
+	free(t->txsample);
+	free(t);
+}
+
+/* add the rate since the previous sample, ms is monotonic time */
+void ratesample(RATETRACK *t, const char *iface, uint64_t rx, uint64_t tx, uint64_t ms, time_t current)
+{
+	uint64_t rxrate, txrate, limit;
+	int maxbw;
+
+	/* close the minute when the clock has moved to the next one */
+	if (t->count && current-(current%60)!=t->minute) {
+		rateminute(t);
+	}
+	t->minute = current-(current%60);
+
+	if (t->primed && ms>t->ms) {
+		rxrate = countercalc(t->rx, rx)*1000/(ms-t->ms);
+		txrate = countercalc(t->tx, tx)*1000/(ms-t->ms);
+
+		/* a rate above the bandwidth limit (+10%) means the counters were reset */
+		maxbw = ibwget(iface);
+		if (maxbw>0) {
+			limit = (uint64_t)maxbw*137500;
+		} else {
+			limit = FP32;
+		}
+
+		if (rxrate<=limit && txrate<=limit && t->count<t->size) {
+			t->rxsample[t->count] = (uint32_t)rxrate;
+			t->txsample[t->count] = (uint32_t)txrate;
+			t->count++;
+		}
+	}
+
+	t->rx = rx;
+	t->tx = tx;
+	t->ms = ms;
+	t->primed = 1;
+}
+
+static int samplecmp(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return (x>y)-(x<y);
+}
+
+/* store peak and p95 of the samples of the current minute into the ring */
+void rateminute(RATETRACK *t)
+{
+	MINUTERATE *m;
+	int p95;
+
+	if (t->count==0) {
+		return;
+	}
+
+	qsort(t->rxsample, t->count, sizeof(uint32_t), samplecmp);
+	qsort(t->txsample, t->count, sizeof(uint32_t), samplecmp);
+	p95 = (t->count*95+99)/100-1;
+
+	m = &t->rates.minute[t->rates.next];
+	m->minute = t->minute;
+	m->rxpeak = t->rxsample[t->count-1];
+	m->txpeak = t->txsample[t->count-1];
+	m->rxp95 = t->rxsample[p95];
+	m->txp95 = t->txsample[p95];
+
+	if (debug) {
+		printf("rates: %s %d samples, rx %u/%u tx %u/%u\n", t->rates.interface, t->count, m->rxpeak, m->rxp95, m->txpeak, m->txp95);
+	}
+
+	t->rates.next = (t->rates.next+1)%RATEMINUTES;
+	t->count = 0;
+}
@@ -0,0 +1,12 @@
+#ifndef RATES_H
+#define RATES_H
+
+int readrates(RATES *rates, const char *iface, const char *dirname);
+int writerates(RATES *rates, const char *iface, const char *dirname);
+void initrates(RATES *rates, const char *iface);
+RATETRACK *ratetrackinit(const char *iface, const char *dirname);
+void ratetrackfree(RATETRACK *t);
+void ratesample(RATETRACK *t, const char *iface, uint64_t rx, uint64_t tx, uint64_t ms, time_t current);
+void rateminute(RATETRACK *t);
+
+#endif
@@ -31,7 +31,7 @@ int main(int argc, char *argv[]) {
 	int i;
 	int currentarg, update=0, query=1, newdb=0, reset=0, sync=0, merged=0, savemerged=0;
 	int active=-1, files=0, force=0, cleartop=0, rebuildtotal=0, traffic=0;
-	int livetraffic=0, defaultiface=1, delete=0, livemode=0;
+	int livetraffic=0, defaultiface=1, delete=0, livemode=0, rateminutes=60;
 	char interface[32], dirname[512], nick[32];
 	char definterface[32], cfgfile[512], *ifacelist=NULL;
 	time_t current;
@@ -113,6 +113,7 @@ int main(int argc, char *argv[]) {
 			printf("         --oneline             show simple parseable format\n");
 			printf("         --dumpdb              show database in parseable format\n");
 			printf("         --xml                 show database in xml format\n");
+			printf("         --rates               show sampled rates per minute\n");
 
 			printf("   Misc:\n");
 			printf("         -i,  --iface          select interface (default: %s)\n", definterface);
@@ -262,6 +263,12 @@ int main(int argc, char *argv[]) {
 			cfg.qmode=9;
 		} else if (strcmp(argv[currentarg],"--xml")==0) {
 			cfg.qmode=8;
+		} else if (strcmp(argv[currentarg],"--rates")==0) {
+			cfg.qmode=10;
+			if (currentarg+1<argc && isdigit(argv[currentarg+1][0])) {
+				rateminutes=atoi(argv[currentarg+1]);
+				currentarg++;
+			}
 		} else if (strcmp(argv[currentarg],"--savemerged")==0) {
 			savemerged=1;
 		} else if ((strcmp(argv[currentarg],"-ru")==0) || (strcmp(argv[currentarg],"--rateunit"))==0) {
@@ -394,7 +401,7 @@ int main(int argc, char *argv[]) {
 	/* save merged database */
 	if (merged && savemerged) {
 		data.lastupdated = 0;
-		if (writedb("mergeddb", ".", 2)) {
+		if (writedb(&data, "mergeddb", ".", 2)) {
 			printf("Database saved as \"mergeddb\" in the current directory.\n");
 		}
 		return 0;
@@ -406,10 +413,10 @@ int main(int argc, char *argv[]) {
 			printf("Error: Not enough free diskspace available.\n");
 			return 1;
 		}
-		readdb(interface, dirname);
+		readdb(&data, interface, dirname);
 		data.currx=0;
 		data.curtx=0;
-		writedb(interface, dirname, 0);
+		writedb(&data, interface, dirname, 0);
 		if (debug)
 			printf("Counters reseted for \"%s\"\n", data.interface);
 	}
@@ -457,7 +464,7 @@ int main(int argc, char *argv[]) {
 			return 1;
 		}
 		if (force) {
-			readdb(interface, dirname);
+			readdb(&data, interface, dirname);
 
 			for (i=0; i<=9; i++) {
 				data.top10[i].rx=data.top10[i].tx=0;
@@ -465,7 +472,7 @@ int main(int argc, char *argv[]) {
 				data.top10[i].used=0;
 			}
 
-			writedb(interface, dirname, 0);
+			writedb(&data, interface, dirname, 0);
 			printf("Top10 cleared for interface \"%s\".\n", data.interface);
 			query=0;
 		} else {
@@ -482,7 +489,7 @@ int main(int argc, char *argv[]) {
 			return 1;
 		}
 		if (force) {
-			readdb(interface, dirname);
+			readdb(&data, interface, dirname);
 
 			data.totalrx=data.totaltx=data.totalrxk=data.totaltxk=0;
 			for (i=0; i<=29; i++) {
@@ -492,7 +499,7 @@ int main(int argc, char *argv[]) {
 				}
 			}
 
-			writedb(interface, dirname, 0);
+			writedb(&data, interface, dirname, 0);
 			printf("Total transfer rebuild completed for interface \"%s\".\n", data.interface);
 			query=0;
 		} else {
@@ -508,10 +515,10 @@ int main(int argc, char *argv[]) {
 			printf("Error: Not enough free diskspace available.\n");
 			return 1;
 		}
-		newdb=readdb(interface, dirname);
+		newdb=readdb(&data, interface, dirname);
 		if (!data.active && !newdb) {
 			data.active=1;
-			writedb(interface, dirname, 0);
+			writedb(&data, interface, dirname, 0);
 			if (debug)
 				printf("Interface \"%s\" enabled.\n", data.interface);
 		} else if (!newdb) {
@@ -522,10 +529,10 @@ int main(int argc, char *argv[]) {
 			printf("Error: Not enough free diskspace available.\n");
 			return 1;
 		}
-		newdb=readdb(interface, dirname);
+		newdb=readdb(&data, interface, dirname);
 		if (data.active && !newdb) {
 			data.active=0;
-			writedb(interface, dirname, 0);
+			writedb(&data, interface, dirname, 0);
 			if (debug)
 				printf("Interface \"%s\" disabled.\n", data.interface);
 		} else if (!newdb) {
@@ -554,7 +561,7 @@ int main(int argc, char *argv[]) {
 					strncpy(interface, di->d_name, 32);
 					if (debug)
 						printf("\nProcessing file \"%s/%s\"...\n", dirname, interface);
-					newdb=readdb(interface, dirname);
+					newdb=readdb(&data, interface, dirname);
 					if (data.active) {
 						/* skip interface if not available */
 						if (!getifinfo(data.interface)) {
@@ -562,11 +569,11 @@ int main(int argc, char *argv[]) {
 								printf("Interface \"%s\" not available, skipping.\n", data.interface);
 							continue;
 						}
-						parseifinfo(newdb);
+						parseifinfo(&data, newdb);
 
 						/* check that the time is correct */
 						if ((current>=data.lastupdated) || force) {
-							writedb(interface, dirname, newdb);
+							writedb(&data, interface, dirname, newdb);
 						} else {
 							/* print error if previous update is more than 6 hours in the future */
 							/* otherwise do nothing */
@@ -596,7 +603,7 @@ int main(int argc, char *argv[]) {
 
 		/* update only selected file */
 		} else {
-			newdb=readdb(interface, dirname);
+			newdb=readdb(&data, interface, dirname);
 			if (data.active) {
 				if (!getifinfo(data.interface) && !force) {
 					getiflist(&ifacelist);
@@ -605,11 +612,11 @@ int main(int argc, char *argv[]) {
 					free(ifacelist);
 					return 1;
 				}
-				parseifinfo(newdb);
+				parseifinfo(&data, newdb);
 				if ((current>=data.lastupdated) || force) {
 					if (strcmp(nick, "none")!=0)
 						strncpy(data.nick, nick, 32);
-					writedb(interface, dirname, newdb);
+					writedb(&data, interface, dirname, newdb);
 				} else {
 					/* print error if previous update is more than 6 hours in the future */
 					/* otherwise do nothing */
@@ -657,7 +664,7 @@ int main(int argc, char *argv[]) {
 						strncpy(interface, di->d_name, 32);
 						if (debug)
 							printf("\nProcessing file \"%s/%s\"...\n", dirname, interface);
-						newdb=readdb(interface, dirname);
+						newdb=readdb(&data, interface, dirname);
 						if (!newdb) {
 							if (cfg.qmode==0) {
 								showdb(5);
@@ -675,7 +682,7 @@ int main(int argc, char *argv[]) {
 			/* show in qmode if there's only one file or qmode!=0 */
 			} else {
 				if (!merged) {
-					newdb=readdb(definterface, dirname);
+					newdb=readdb(&data, definterface, dirname);
 				}
 				if (!newdb) {
 					if (cfg.qmode==5) {
@@ -685,7 +692,9 @@ int main(int argc, char *argv[]) {
 							printf("\n                      rx      /      tx      /     total\n");
 						}
 					}
-					if (cfg.qmode!=8) {
+					if (cfg.qmode==10) {
+						showrates(dirname, rateminutes);
+					} else if (cfg.qmode!=8) {
 						showdb(cfg.qmode);
 					} else {
 						printf("<vnstat version=\"%s\" xmlversion=\"%d\">\n", VNSTATVERSION, XMLVERSION);
@@ -698,7 +707,7 @@ int main(int argc, char *argv[]) {
 		/* show only specified file */
 		} else {
 			if (!merged) {
-				newdb=readdb(interface, dirname);
+				newdb=readdb(&data, interface, dirname);
 			}
 			if (!newdb) {
 				if (cfg.qmode==5) {
@@ -708,7 +717,9 @@ int main(int argc, char *argv[]) {
 						printf("\n                      rx      /      tx      /     total\n");
 					}
 				}
-				if (cfg.qmode!=8) {
+				if (cfg.qmode==10) {
+					showrates(dirname, rateminutes);
+				} else if (cfg.qmode!=8) {
 					showdb(cfg.qmode);
 				} else {
 					printf("<vnstat version=\"%s\" xmlversion=\"%d\">\n", VNSTATVERSION, XMLVERSION);
@@ -755,7 +766,7 @@ int main(int argc, char *argv[]) {
 
 int synccounters(const char *iface, const char *dirname)
 {
-	readdb(iface, dirname);
+	readdb(&data, iface, dirname);
 	if (!getifinfo(iface)) {
 		printf("Error: Unable to sync unavailable interface \"%s\".", iface);
 		return 0;
@@ -765,6 +776,6 @@ int synccounters(const char *iface, const char *dirname)
 	data.currx = ifinfo.rx;
 	data.curtx = ifinfo.tx;
 
-	writedb(iface, dirname, 0);
+	writedb(&data, iface, dirname, 0);
 	return 1;
 }
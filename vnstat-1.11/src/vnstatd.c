@@ -21,24 +21,29 @@ vnStat daemon - Copyright (c) 2008-11 Teemu Toivola <tst@iki.fi>
 #include "dbcache.h"
 #include "misc.h"
 #include "cfg.h"
+#include "rates.h"
 #include "vnstatd.h"
 
+static UPDATEPOOL pool;
+
 int main(int argc, char *argv[])
 {
-	int currentarg, running = 1, updateinterval, dbcount, dodbsave, rundaemon;
-	int dbsaved = 1, showhelp = 1, sync = 0, saveinterval, forcesave = 0, noadd = 0;
+	int currentarg, running = 1, dbcount, dodbsave, rundaemon;
+	int dbsaved = 1, showhelp = 1, sync = 0, forcesave = 0, noadd = 0;
+	int linkfd = -1, samplefd = -1, timerfd = -1, i, status, saves;
 	uint32_t dbhash = 0;
 	char cfgfile[512], dirname[512];
 	DIR *dir;
 	struct dirent *di;
 	datanode *datalist;
-	time_t current, prevdbupdate, prevdbsave;
+	time_t current;
+	uint64_t now, nextpoll, nextupdate, prevdbsave, saveinterval, deadline;
 
 	noexit = 1;        /* disable exits in functions */
 	debug = 0;         /* debug disabled by default */
 	rundaemon = 0;     /* daemon disabled by default */
 	cfgfile[0] = '\0';
-	prevdbupdate = prevdbsave = dbcount = 0;
+	dbcount = 0;
 
 	/* early check for debug and config parameter */
 	if (argc > 1) {
@@ -66,10 +71,8 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
-	/* init dirname and other config settings */
+	/* init dirname */
 	strncpy(dirname, cfg.dbdir, 512);
-	updateinterval = cfg.updateinterval;
-	saveinterval = cfg.saveinterval*60;
 
 	/* parse parameters, maybe not the best way but... */
 	for (currentarg=1; currentarg<argc; currentarg++) {
@@ -187,20 +190,61 @@ int main(int argc, char *argv[])
 		daemonize();
 	}
 
+	/* dbcheck and the updates share one read of the interface counters per poll */
+	ifsnap.shared = 1;
+
+	/* threads have to be started after the fork */
+	updatestart();
+
+	/* with link notifications the interface list is only checked in full after a
+	   database read or lost notifications, otherwise the notifications are applied */
+#if defined(__linux__)
+	linkfd = linkeventopen();
+	if (debug && linkfd<0)
+		printf("Link notifications not available, polling interface list.\n");
+
+	/* sub-second rate sampling between polls if enabled */
+	samplefd = sampleopen(samplefd);
+
+	/* wakes the poll wait at the next deadline */
+	if ((timerfd=timerfd_create(CLOCK_MONOTONIC, 0))<0 && debug)
+		printf("Deadline timer not available, using select timeout.\n");
+#endif
+
+	/* polls, updates and saves are scheduled with absolute deadlines (ms) on the
+	   monotonic clock so the time spent working doesn't shift the next ones */
+	now = monotonicms();
+	nextpoll = nextupdate = prevdbsave = now;
+
 	/* main loop */
 	while(running) {
 
-		/* keep track of time */
+		/* keep track of time, current is only used for the data */
 		current = time(NULL);
+		now = monotonicms();
+
+		if (now>=nextpoll) {
+			nextpoll = nextdeadline(nextpoll, (uint64_t)cfg.pollinterval*1000, now);
+		}
+
+#if defined(__linux__)
+		ifsnapread();
+#endif
 
 		/* track interface status only if at least one database exists */
-		if (dbcount!=0) {
+		if (dbcount!=0 && (linkfd<0 || dbhash==0)) {
 			dbhash = dbcheck(dbhash, &forcesave);
 		}
 
-		if ((current-prevdbupdate)>=updateinterval) {
+		/* alter save interval if all interfaces are unavailable */
+		if (cacheactivecount()) {
+			saveinterval = (uint64_t)cfg.saveinterval*60000;
+		} else {
+			saveinterval = (uint64_t)cfg.offsaveinterval*60000;
+		}
 
-			updateinterval = cfg.updateinterval;
+		/* a save is done with an update, a due save brings the update forward */
+		if (now>=nextupdate || (dbcount!=0 && now>=prevdbsave+saveinterval)) {
 
 			if (debug) {
 				cacheshow();
@@ -237,16 +281,16 @@ int main(int argc, char *argv[])
 					closedir(dir);
 					sync = 0;
 
-					/* disable update interval check for one loop if database list was refreshed */
-					/* otherwise increase default update interval since there's nothing else to do */
+					/* update right away without waiting if database list was refreshed */
+					/* otherwise check the directory again in two minutes since there's nothing else to do */
 					if (dbcount) {
-						updateinterval = 0;
+						nextupdate = now;
 						intsignal = 42;
-						prevdbsave = current;
+						prevdbsave = now;
 						/* list monitored interfaces to log */
 						cachestatus();
 					} else {
-						updateinterval = 120;
+						nextupdate = now+120000;
 					}
 
 				} else {
@@ -264,126 +308,93 @@ int main(int argc, char *argv[])
 
 			/* update data cache */
 			} else {
-				prevdbupdate = current;
-				datalist = dataptr;
-
-				/* alter save interval if all interfaces are unavailable */
-				if (cacheactivecount()) {
-					saveinterval = cfg.saveinterval*60;
-				} else {
-					saveinterval = cfg.offsaveinterval*60;
+				if (now>=nextupdate) {
+					nextupdate = nextdeadline(nextupdate, (uint64_t)cfg.updateinterval*1000, now);
 				}
 
-				if ((current-prevdbsave)>=(saveinterval) || forcesave) {
+				/* a forced save leaves the save schedule as it is */
+				dodbsave = 0;
+				if (now>=prevdbsave+saveinterval) {
+					dodbsave = 1;
+					prevdbsave = nextdeadline(prevdbsave, saveinterval, now)-saveinterval;
+				}
+				if (forcesave) {
 					dodbsave = 1;
 					forcesave = 0;
-					prevdbsave = current;
-				} else {
-					dodbsave = 0;
 				}
 
-				/* check all list entries*/
-				while (datalist!=NULL) {
+				/* update all list entries in parallel, the results are handled in list order */
+				if (updateall(current, dodbsave, dirname)<0) {
+					snprintf(errorstring, 512, "Update memory allocation failed, exiting.");
+					printe(PT_Error);
 
-					if (debug) {
-						printf("d: processing %s (%d)...\n", datalist->data.interface, dodbsave);
+					/* clean daemon stuff before exit */
+					if (rundaemon && !debug) {
+						close(pidfile);
+						unlink(cfg.pidfile);
 					}
+					ibwflush();
+					return 1;
+				}
 
-					/* get data from cache if available */
-					if (cacheget(datalist)==0) {
-
-						/* try to read data from file if not cached */
-						if (readdb(datalist->data.interface, dirname)!=-1) {
-							/* mark cache as filled on read success and force interface status update */
-							datalist->filled = 1;
-							dbhash = 0;
-						} else {
-							datalist = datalist->next;
-							continue;						
-						}
-					}
+				saves = 0;
+				for (i=0; i<pool.jobs; i++) {
 
-					/* get info if interface has been marked as active */
-					if (data.active) {
-						if (getifinfo(data.interface)) {
-							if (datalist->sync) { /* if --sync was used during startup */
-								data.currx = ifinfo.rx;
-								data.curtx = ifinfo.tx;
-								datalist->sync = 0;
-							} else {
-								parseifinfo(0);
-							}
-						} else {
-							/* disable interface since we can't access its data */
-							data.active = 0;
-							snprintf(errorstring, 512, "Interface \"%s\" not available, disabling.", data.interface);
-							printe(PT_Info);
-						}
-					} else if (debug) {
-						printf("d: interface is disabled\n");
+					datalist = pool.job[i].dn;
+					status = pool.job[i].status;
+
+					/* force interface status update after a database read */
+					if (status & UPD_READ) {
+						dbhash = 0;
 					}
 
-					/* check that the time is correct */
-					if (current>=data.lastupdated) {
-						data.lastupdated = current;
-						cacheupdate();
-					} else {
-						/* skip update if previous update is less than a day in the future */
-						/* otherwise exit with error message since the clock is problably messed */
-						if (data.lastupdated>(current+86400)) {
-							snprintf(errorstring, 512, "Interface \"%s\" has previous update date too much in the future, exiting.", data.interface);
-							printe(PT_Error);
+					/* exit with error message since the clock is problably messed */
+					if (status & UPD_FUTURE) {
+						snprintf(errorstring, 512, "Interface \"%s\" has previous update date too much in the future, exiting.", datalist->data.interface);
+						printe(PT_Error);
 
-							/* clean daemon stuff before exit */
-							if (rundaemon && !debug) {
-								close(pidfile);
-								unlink(cfg.pidfile);
-							}
-							ibwflush();
-							return 1;
-						} else {
-							datalist = datalist->next;
-							continue;
+						/* clean daemon stuff before exit */
+						if (rundaemon && !debug) {
+							close(pidfile);
+							unlink(cfg.pidfile);
 						}
+						ibwflush();
+						return 1;
 					}
 
-					/* write data to file if now is the time for it */
-					if (dodbsave) {
-						if (checkdb(datalist->data.interface, dirname)) {
-							if (spacecheck(dirname)) {
-								if (writedb(datalist->data.interface, dirname, 0)) {
-									if (!dbsaved) {
-										snprintf(errorstring, 512, "Database write possible again.");
-										printe(PT_Info);
-										dbsaved = 1;
-									}
-								} else {
-									if (dbsaved) {
-										snprintf(errorstring, 512, "Unable to write database, continuing with cached data.");
-										printe(PT_Error);
-										dbsaved = 0;
-									}
-								}
-							} else {
-								/* show freespace error only once */
-								if (dbsaved) {
-									snprintf(errorstring, 512, "Free diskspace check failed, unable to write database, continuing with cached data.");
-									printe(PT_Error);
-									dbsaved = 0;
-								}
-							}
-						} else {
-							/* remove interface from update list since the database file doesn't exist anymore */
-							snprintf(errorstring, 512, "Database for interface \"%s\" no longer exists, removing from update list.", datalist->data.interface);
+					if (status & UPD_SAVED) {
+						saves++;
+						if (!dbsaved) {
+							snprintf(errorstring, 512, "Database write possible again.");
 							printe(PT_Info);
-							datalist = cacheremove(datalist->data.interface);
-							dbcount--;
-							cachestatus();
-							continue;
+							dbsaved = 1;
 						}
+					} else if (status & UPD_SAVEFAIL) {
+						if (dbsaved) {
+							snprintf(errorstring, 512, "Unable to write database, continuing with cached data.");
+							printe(PT_Error);
+							dbsaved = 0;
+						}
+					} else if (status & UPD_NOSPACE) {
+						/* show freespace error only once */
+						if (dbsaved) {
+							snprintf(errorstring, 512, "Free diskspace check failed, unable to write database, continuing with cached data.");
+							printe(PT_Error);
+							dbsaved = 0;
+						}
+					} else if (status & UPD_REMOVE) {
+						/* remove interface from update list since the database file doesn't exist anymore */
+						snprintf(errorstring, 512, "Database for interface \"%s\" no longer exists, removing from update list.", datalist->data.interface);
+						printe(PT_Info);
+						cacheremove(datalist->data.interface);
+						dbcount--;
+						cachestatus();
 					}
+				}
 
-					datalist = datalist->next;
+				/* the saves renamed files, one directory sync makes all of them durable */
+				if (saves) {
+					syncdir(dirname);
 				}
 
 				if (debug) {
@@ -393,7 +404,21 @@ int main(int argc, char *argv[])
 		} /* dbupdate */
 
 		if (running && intsignal==0) {
-			sleep(cfg.pollinterval);
+
+			/* sleep until the first of the poll, update and save deadlines */
+			deadline = nextpoll;
+			if (nextupdate<deadline) {
+				deadline = nextupdate;
+			}
+			if (dbcount!=0 && prevdbsave+saveinterval<deadline) {
+				deadline = prevdbsave+saveinterval;
+			}
+
+#if defined(__linux__)
+			pollwait(deadline, timerfd, linkfd, samplefd, dirname, dbcount, &dbhash, &forcesave);
+#else
+			pollwait(deadline);
+#endif
 		}
 
 		/* take actions from signals */
@@ -409,6 +434,9 @@ int main(int argc, char *argv[])
 					if (loadcfg(cfgfile)) {
 						strncpy(dirname, cfg.dbdir, 512);
 					}
+#if defined(__linux__)
+					samplefd = sampleopen(samplefd);
+#endif
 					break;
 
 				case SIGINT:
@@ -437,9 +465,22 @@ int main(int argc, char *argv[])
 
 	} /* while */
 
+	updatestop();
 	cacheflush(dirname);
 	ibwflush();
 
+	if (linkfd>=0) {
+		close(linkfd);
+	}
+
+	if (samplefd>=0) {
+		close(samplefd);
+	}
+
+	if (timerfd>=0) {
+		close(timerfd);
+	}
+
 	/* clean daemon stuff */
 	if (rundaemon && !debug) {
 		close(pidfile);
@@ -582,7 +623,7 @@ int addinterfaces(const char *dirname)
 		}
 
 		/* create database for interface */
-		initdb();
+		initdb(&data);
 		strncpy(data.interface, interface, 32);
 		strncpy(data.nick, data.interface, 32);
 		if (!getifinfo(interface)) {
@@ -590,8 +631,8 @@ int addinterfaces(const char *dirname)
 				printf("getifinfo failed, skip\n");
 			continue;
 		}
-		parseifinfo(1);
-		if (!writedb(interface, dirname, 1)) {
+		parseifinfo(&data, 1);
+		if (!writedb(&data, interface, dirname, 1)) {
 			continue;
 		}
 		count++;
@@ -613,3 +654,383 @@ int addinterfaces(const char *dirname)
 	free(ifacelist);
 	return count;
 }
+
+/* start the update threads, with none started the main thread does all updates */
+void updatestart(void)
+{
+	sigset_t all, old;
+
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.work, NULL);
+	pthread_cond_init(&pool.done, NULL);
+	pool.threads = pool.stop = 0;
+	pool.job = NULL;
+	pool.size = pool.jobs = pool.next = pool.finished = 0;
+
+	/* signals are left to the main thread */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	while (pool.threads<UPDATETHREADS) {
+		if (pthread_create(&pool.thread[pool.threads], NULL, updateworker, NULL)!=0) {
+			break;
+		}
+		pool.threads++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (debug)
+		printf("%d update threads started.\n", pool.threads);
+}
+
+void updatestop(void)
+{
+	int i;
+
+	pthread_mutex_lock(&pool.lock);
+	pool.stop = 1;
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (i=0; i<pool.threads; i++) {
+		pthread_join(pool.thread[i], NULL);
+	}
+	pool.threads = 0;
+
+	free(pool.job);
+	pool.job = NULL;
+	pool.size = pool.jobs = 0;
+}
+
+/* update every cached interface once, returns the number of interfaces or -1 */
+int updateall(time_t current, int dodbsave, char *dirname)
+{
+	UPDATEJOB *job;
+	datanode *p;
+	int i, count;
+
+	count = cachecount();
+
+	if (count>pool.size) {
+		if ((job=realloc(pool.job, count*sizeof(UPDATEJOB)))==NULL) {
+			return -1;
+		}
+		pool.job = job;
+		pool.size = count;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+
+	for (i=0, p=dataptr; p!=NULL; i++, p=p->next) {
+		pool.job[i].dn = p;
+		pool.job[i].status = 0;
+	}
+	pool.jobs = count;
+	pool.next = pool.finished = 0;
+	pool.current = current;
+	pool.dodbsave = dodbsave;
+	pool.dirname = dirname;
+
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+
+	/* take jobs in the main thread too and then wait for the ones still running */
+	updatejobs();
+
+	pthread_mutex_lock(&pool.lock);
+	while (pool.finished<pool.jobs) {
+		pthread_cond_wait(&pool.done, &pool.lock);
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	return count;
+}
+
+/* take jobs of the current round until none are left */
+void updatejobs(void)
+{
+	int i;
+
+	pthread_mutex_lock(&pool.lock);
+
+	while (pool.next<pool.jobs) {
+		i = pool.next++;
+		pthread_mutex_unlock(&pool.lock);
+
+		pool.job[i].status = updateinterface(pool.job[i].dn, pool.current, pool.dodbsave, pool.dirname);
+
+		pthread_mutex_lock(&pool.lock);
+		pool.finished++;
+		if (pool.finished==pool.jobs) {
+			pthread_cond_signal(&pool.done);
+		}
+	}
+
+	pthread_mutex_unlock(&pool.lock);
+}
+
+void *updateworker(void *arg)
+{
+	int stop;
+
+	/* without its own errorstring and ifinfo the thread takes no jobs */
+	if (!threadlocalinit()) {
+		return NULL;
+	}
+
+	do {
+		pthread_mutex_lock(&pool.lock);
+		while (!pool.stop && pool.next>=pool.jobs) {
+			pthread_cond_wait(&pool.work, &pool.lock);
+		}
+		stop = pool.stop;
+		pthread_mutex_unlock(&pool.lock);
+
+		if (!stop) {
+			updatejobs();
+		}
+	} while (!stop);
+
+	return NULL;
+}
+
+/* update one cached interface and save it if asked, only touches its own cache entry */
+int updateinterface(datanode *dn, time_t current, int dodbsave, char *dirname)
+{
+	char interface[32];
+	int status = 0;
+
+	if (debug) {
+		printf("d: processing %s (%d)...\n", dn->data.interface, dodbsave);
+	}
+
+	/* use the cached data if it's valid */
+	if (cacheget(dn)==0) {
+
+		/* try to read data from file into the cache entry if not cached */
+		strncpy(interface, dn->data.interface, 32);
+		if (readdb(&dn->data, interface, dirname)!=-1) {
+			/* mark cache as filled on read success, the first save writes it in full */
+			dn->filled = 1;
+			dn->journal = -1;
+			status |= UPD_READ;
+		} else {
+			/* keep the name, a failed read may have overwritten it */
+			strncpy(dn->data.interface, interface, 32);
+			return status;
+		}
+	}
+
+	/* check that the time is correct */
+	if (current<dn->data.lastupdated) {
+		/* skip update if previous update is less than a day in the future */
+		if (dn->data.lastupdated>(current+86400)) {
+			status |= UPD_FUTURE;
+		}
+		return status;
+	}
+
+	/* get info if interface has been marked as active, the cache entry is updated in place */
+	if (dn->data.active) {
+		if (getifinfo(dn->data.interface)) {
+			if (dn->sync) { /* if --sync was used during startup */
+				dn->data.currx = ifinfo.rx;
+				dn->data.curtx = ifinfo.tx;
+				dn->sync = 0;
+			} else {
+				parseifinfo(&dn->data, 0);
+			}
+		} else {
+			/* disable interface since we can't access its data */
+			dn->data.active = 0;
+			snprintf(errorstring, 512, "Interface \"%s\" not available, disabling.", dn->data.interface);
+			printe(PT_Info);
+		}
+	} else if (debug) {
+		printf("d: interface is disabled\n");
+	}
+	dn->data.lastupdated = current;
+
+	/* write data to file if now is the time for it */
+	if (dodbsave) {
+		if (checkdb(dn->data.interface, dirname)) {
+			if (spacecheck(dirname)) {
+				if (cachesave(dn, dirname)) {
+					status |= UPD_SAVED;
+					if (dn->rates!=NULL) {
+						writerates(&dn->rates->rates, dn->data.interface, dirname);
+					}
+				} else {
+					status |= UPD_SAVEFAIL;
+				}
+			} else {
+				status |= UPD_NOSPACE;
+			}
+		} else {
+			status |= UPD_REMOVE;
+		}
+	}
+
+	return status;
+}
+
+#if defined(__linux__)
+/* (re)arm the rate sampling timer, returns -1 when sampling is disabled or not available */
+int sampleopen(int fd)
+{
+	struct itimerspec its;
+
+	if (cfg.sampleinterval==0) {
+		if (fd>=0) {
+			close(fd);
+		}
+		return -1;
+	}
+
+	its.it_interval.tv_sec = cfg.sampleinterval/1000;
+	its.it_interval.tv_nsec = (cfg.sampleinterval%1000)*1000000;
+	its.it_value = its.it_interval;
+
+	if (fd<0) {
+		if ((fd=timerfd_create(CLOCK_MONOTONIC, 0))<0 || fcntl(fd, F_SETFL, O_NONBLOCK)<0) {
+			if (fd>=0) {
+				close(fd);
+			}
+			fd = -1;
+		}
+	}
+
+	if (fd<0 || timerfd_settime(fd, 0, &its, NULL)<0) {
+		if (fd>=0) {
+			close(fd);
+		}
+		snprintf(errorstring, 512, "Rate sampling timer not available, sampling disabled.");
+		printe(PT_Error);
+		return -1;
+	}
+
+	if (debug)
+		printf("Sampling rates every %d ms.\n", cfg.sampleinterval);
+
+	return fd;
+}
+
+/* wait until deadline (monotonic ms) or a signal, link notifications are
+   applied and rates sampled as they come */
+void pollwait(uint64_t deadline, int timerfd, int linkfd, int samplefd, const char *dirname, int dbcount, uint32_t *dbhash, int *forcesave)
+{
+	LINKEVENT linkevent[LINKEVENTS];
+	struct itimerspec its;
+	struct timespec ts;
+	struct timeval tv, *timeout;
+	uint64_t ticks, now;
+	fd_set rfds;
+	int maxfd, linkcount, ready;
+
+	/* without the deadline timer select gets the time left */
+	if (timerfd>=0) {
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = deadline/1000;
+		its.it_value.tv_nsec = (deadline%1000)*1000000;
+		if (timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &its, NULL)<0) {
+			timerfd = -1;
+		}
+	}
+
+	while (intsignal==0) {
+
+		now = monotonicms();
+		if (timerfd<0 && now>=deadline) {
+			break;
+		}
+
+		FD_ZERO(&rfds);
+		maxfd = -1;
+		if (timerfd>=0) {
+			FD_SET(timerfd, &rfds);
+			maxfd = timerfd;
+		}
+		if (linkfd>=0) {
+			FD_SET(linkfd, &rfds);
+			if (linkfd>maxfd) {
+				maxfd = linkfd;
+			}
+		}
+		if (samplefd>=0) {
+			FD_SET(samplefd, &rfds);
+			if (samplefd>maxfd) {
+				maxfd = samplefd;
+			}
+		}
+
+		if (timerfd>=0) {
+			timeout = NULL;
+		} else {
+			tv.tv_sec = (deadline-now)/1000;
+			tv.tv_usec = ((deadline-now)%1000)*1000;
+			timeout = &tv;
+		}
+
+		if ((ready=select(maxfd+1, &rfds, NULL, NULL, timeout))<0) {
+			/* a signal ends the wait through intsignal, other errors sleep it out */
+			if (errno!=EINTR && (now=monotonicms())<deadline) {
+				ts.tv_sec = (deadline-now)/1000;
+				ts.tv_nsec = ((deadline-now)%1000)*1000000;
+				nanosleep(&ts, NULL);
+				break;
+			}
+			continue;
+		}
+		if (ready==0) {
+			continue;
+		}
+
+		if (linkfd>=0 && FD_ISSET(linkfd, &rfds)) {
+			linkcount = linkeventread(linkfd, linkevent);
+			if (linkcount<0) {
+				*dbhash = 0;
+			} else if (dbcount!=0) {
+				cachelinkevents(linkevent, linkcount, forcesave);
+			}
+		}
+
+		if (samplefd>=0 && FD_ISSET(samplefd, &rfds) && read(samplefd, &ticks, sizeof(ticks))==sizeof(ticks)) {
+			if (ifsnapread()) {
+				cachesample(monotonicms(), time(NULL), dirname);
+			}
+		}
+
+		if (timerfd>=0 && FD_ISSET(timerfd, &rfds)) {
+			if (read(timerfd, &ticks, sizeof(ticks))<0 && debug) {
+				printf("Deadline timer read failed.\n");
+			}
+			break;
+		}
+	}
+}
+#else
+/* wait until deadline (monotonic ms) or a signal */
+void pollwait(uint64_t deadline)
+{
+	struct timespec ts;
+	uint64_t now;
+
+	while (intsignal==0 && (now=monotonicms())<deadline) {
+		ts.tv_sec = (deadline-now)/1000;
+		ts.tv_nsec = ((deadline-now)%1000)*1000000;
+		nanosleep(&ts, NULL);
+	}
+}
+#endif
+
+/* the deadline of a periodic timer following the one at deadline, periods
+   already missed at now are skipped */
+uint64_t nextdeadline(uint64_t deadline, uint64_t interval, uint64_t now)
+{
+	if (deadline+interval>now) {
+		return deadline+interval;
+	}
+
+	return now+interval-(now-deadline)%interval;
+}
@@ -1,7 +1,46 @@
 #ifndef VNSTATD_H
 #define VNSTATD_H
 
+/* result bits of updating one interface */
+#define UPD_READ 1        /* database was read into the cache */
+#define UPD_FUTURE 2      /* previous update is more than a day in the future */
+#define UPD_SAVED 4
+#define UPD_SAVEFAIL 8
+#define UPD_NOSPACE 16    /* free diskspace check failed, not saved */
+#define UPD_REMOVE 32     /* database file no longer exists */
+
+typedef struct {
+	datanode *dn;
+	int status;
+} UPDATEJOB;
+
+/* one update round of the cached interfaces shared by the update threads */
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t work, done;
+	pthread_t thread[UPDATETHREADS];
+	int threads, stop;
+	UPDATEJOB *job;
+	int size, jobs, next, finished;
+	time_t current;
+	int dodbsave;
+	char *dirname;
+} UPDATEPOOL;
+
 void daemonize(void);
 int addinterfaces(const char *dirname);
+void updatestart(void);
+void updatestop(void);
+int updateall(time_t current, int dodbsave, char *dirname);
+void updatejobs(void);
+void *updateworker(void *arg);
+int updateinterface(datanode *dn, time_t current, int dodbsave, char *dirname);
+#if defined(__linux__)
+int sampleopen(int fd);
+void pollwait(uint64_t deadline, int timerfd, int linkfd, int samplefd, const char *dirname, int dbcount, uint32_t *dbhash, int *forcesave);
+#else
+void pollwait(uint64_t deadline);
+#endif
+uint64_t nextdeadline(uint64_t deadline, uint64_t interval, uint64_t now);
 
 #endif
@@ -276,7 +276,7 @@ int main(int argc, char *argv[])
 			return 1;
 		}
 	} else {
-		if (readdb(interface, dirname)==1) {
+		if (readdb(&data, interface, dirname)==1) {
 			return 1;
 		}
 	}